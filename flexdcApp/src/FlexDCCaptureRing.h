@@ -0,0 +1,93 @@
+/*
+FILENAME...   FlexDCCaptureRing.h
+USAGE...      Lock-free single-producer single-consumer ring of position samples for the Nanomotion FlexDC controller
+
+Jose G.C. Gabadinho
+April 2021
+*/
+
+#ifndef _FLEXDCCAPTURERING_H_
+#define _FLEXDCCAPTURERING_H_
+
+#include <stddef.h>
+
+#include <epicsAtomic.h>
+#include <epicsTime.h>
+
+
+
+#define FLEXDC_CAPTURE_RING_SIZE 4096 // Must be a power of 2
+
+
+
+struct FlexDCSample {
+    epicsTimeStamp time;
+    long position;
+    long error;
+};
+
+
+
+/** Fixed-size ring of samples, written by one thread and read by another without any lock.
+  * The producer only moves head, the consumer only moves tail; when the ring is full, new samples are dropped and counted.
+  */
+class FlexDCCaptureRing {
+
+public:
+    FlexDCCaptureRing(): head(0), tail(0), dropped(0) {}
+
+    /** Producer side: appends a sample.
+      *
+      * \return false if the ring was full and the sample dropped
+      */
+    bool push(const FlexDCSample &sample) {
+        size_t h = epicsAtomicGetSizeT(&this->head);
+
+        if (h - epicsAtomicGetSizeT(&this->tail) >= FLEXDC_CAPTURE_RING_SIZE) {
+            epicsAtomicIncrSizeT(&this->dropped);
+            return false;
+        }
+        this->samples[h & (FLEXDC_CAPTURE_RING_SIZE-1)] = sample;
+        epicsAtomicWriteMemoryBarrier();
+        epicsAtomicSetSizeT(&this->head, h+1);
+        return true;
+    }
+
+    /** Consumer side: removes up to max_samples samples, oldest first.
+      *
+      * \return Number of samples copied into out
+      */
+    size_t pop(FlexDCSample *out, size_t max_samples) {
+        size_t t = epicsAtomicGetSizeT(&this->tail);
+        size_t available = epicsAtomicGetSizeT(&this->head) - t;
+        size_t n;
+
+        epicsAtomicReadMemoryBarrier();
+        if (available > max_samples) available = max_samples;
+        for (n=0; n<available; n++) {
+            out[n] = this->samples[(t+n) & (FLEXDC_CAPTURE_RING_SIZE-1)];
+        }
+        epicsAtomicReadMemoryBarrier();
+        epicsAtomicSetSizeT(&this->tail, t+available);
+        return available;
+    }
+
+    /** Consumer side: discards all pending samples.
+      *
+      */
+    void clear() {
+        epicsAtomicSetSizeT(&this->tail, epicsAtomicGetSizeT(&this->head));
+    }
+
+    size_t getDropped() {
+        return epicsAtomicGetSizeT(&this->dropped);
+    }
+
+private:
+    FlexDCSample samples[FLEXDC_CAPTURE_RING_SIZE];
+    size_t head;
+    size_t tail;
+    size_t dropped;
+};
+
+#endif // _FLEXDCCAPTURERING_H_
@@ -0,0 +1,230 @@
+/*
+FILENAME...   FlexDCCommandEncoder.h
+USAGE...      Bounded, allocation-free command string encoder for the Nanomotion FlexDC controller
+
+Jose G.C. Gabadinho
+April 2021
+*/
+
+#ifndef _FLEXDCCOMMANDENCODER_H_
+#define _FLEXDCCOMMANDENCODER_H_
+
+#include <stddef.h>
+
+
+
+/** Appends command fragments to a fixed-size buffer, always keeping it null-terminated.
+  * Literal lengths are resolved at compile time, and integers are converted without going through printf.
+  * Once the buffer is full, further appends are dropped and ok() returns false.
+  */
+class FlexDCCommandBuffer {
+
+public:
+    FlexDCCommandBuffer(char *buffer, size_t size): pos(buffer), last(buffer+size-1), overflow(false) {
+        *pos = '\0';
+    }
+
+    FlexDCCommandBuffer& put(char c) {
+        if (pos < last) {
+            *pos++ = c;
+            *pos = '\0';
+        } else {
+            overflow = true;
+        }
+        return *this;
+    }
+
+    template<size_t N>
+    FlexDCCommandBuffer& put(const char (&literal)[N]) {
+        return putn(literal, N-1);
+    }
+
+    FlexDCCommandBuffer& puts(const char *str) {
+        while (*str) put(*str++);
+        return *this;
+    }
+
+    FlexDCCommandBuffer& put(long value) {
+        char digits[24];
+        char *d = digits+sizeof(digits);
+        unsigned long magnitude = (value < 0) ? 0UL-(unsigned long)value : (unsigned long)value;
+
+        do {
+            *--d = (char)('0' + magnitude%10);
+            magnitude /= 10;
+        } while (magnitude);
+        if (value < 0) {
+            *--d = '-';
+        }
+        return putn(d, digits+sizeof(digits)-d);
+    }
+
+    FlexDCCommandBuffer& put(int value) {
+        return put((long)value);
+    }
+
+    bool ok() const {
+        return !overflow;
+    }
+
+    size_t remaining() const {
+        return last-pos;
+    }
+
+private:
+    FlexDCCommandBuffer& putn(const char *str, size_t len) {
+        if ((size_t)(last-pos) < len) {
+            overflow = true;
+            return *this;
+        }
+        while (len--) *pos++ = *str++;
+        *pos = '\0';
+        return *this;
+    }
+
+    char *pos;
+    char *last;
+    bool overflow;
+};
+
+
+
+/** One specialization per command, each encoding it for the given axis letter.
+  * Output is byte-for-byte the same as the matching printf-style format of FlexDCMotorDriver.h.
+  */
+enum flexdcCommand {
+    CMD_MOVE_ABS,
+    CMD_MOVE_REL,
+    CMD_MOVE_SETUP,
+    CMD_BEGIN,
+    CMD_FORCE_POS,
+    CMD_STOP,
+    CMD_POWER,
+    CMD_MACRO_KILLINIT,
+    CMD_HOME_MACRO,
+    CMD_ARRAY_SET,
+    CMD_ARRAY_GET,
+    CMD_PROFILE_START,
+    CMD_RECORDER_ARM,
+    CMD_SETTLE_WINDOW,
+    CMD_SNAPSHOT_TOKEN
+};
+
+template<flexdcCommand C> struct FlexDCCommand;
+
+// %cMO=1;%cMM=0;%cSM=0;%cSP=%d;%cAP=%ld;%cBG
+template<> struct FlexDCCommand<CMD_MOVE_ABS> {
+    static bool encode(FlexDCCommandBuffer &out, char axis, int velocity, long position) {
+        return out.put(axis).put("MO=1;").put(axis).put("MM=0;").put(axis).put("SM=0;").put(axis).put("SP=").put(velocity)
+                  .put(';').put(axis).put("AP=").put(position).put(';').put(axis).put("BG").ok();
+    }
+};
+
+// %cMO=1;%cMM=0;%cSM=0;%cSP=%d;%cRP=%ld;%cBG
+template<> struct FlexDCCommand<CMD_MOVE_REL> {
+    static bool encode(FlexDCCommandBuffer &out, char axis, int velocity, long position) {
+        return out.put(axis).put("MO=1;").put(axis).put("MM=0;").put(axis).put("SM=0;").put(axis).put("SP=").put(velocity)
+                  .put(';').put(axis).put("RP=").put(position).put(';').put(axis).put("BG").ok();
+    }
+};
+
+// %cMO=1;%cMM=0;%cSM=0;%cSP=%d;%cAP=%ld or %cRP=%ld, without the begin
+template<> struct FlexDCCommand<CMD_MOVE_SETUP> {
+    static bool encode(FlexDCCommandBuffer &out, char axis, bool relative, int velocity, long position) {
+        return out.put(axis).put("MO=1;").put(axis).put("MM=0;").put(axis).put("SM=0;").put(axis).put("SP=").put(velocity)
+                  .put(';').put(axis).put(relative ? "RP=" : "AP=").put(position).ok();
+    }
+};
+
+// %cBG
+template<> struct FlexDCCommand<CMD_BEGIN> {
+    static bool encode(FlexDCCommandBuffer &out, char axis) {
+        return out.put(axis).put("BG").ok();
+    }
+};
+
+// %cPS=%ld
+template<> struct FlexDCCommand<CMD_FORCE_POS> {
+    static bool encode(FlexDCCommandBuffer &out, char axis, long position) {
+        return out.put(axis).put("PS=").put(position).ok();
+    }
+};
+
+// %cST
+template<> struct FlexDCCommand<CMD_STOP> {
+    static bool encode(FlexDCCommandBuffer &out, char axis) {
+        return out.put(axis).put("ST").ok();
+    }
+};
+
+// %cMO=%d
+template<> struct FlexDCCommand<CMD_POWER> {
+    static bool encode(FlexDCCommandBuffer &out, char axis, bool on) {
+        return out.put(axis).put("MO=").put(on ? '1' : '0').ok();
+    }
+};
+
+// %cQK;%cQI
+template<> struct FlexDCCommand<CMD_MACRO_KILLINIT> {
+    static bool encode(FlexDCCommandBuffer &out, char axis) {
+        return out.put(axis).put("QK;").put(axis).put("QI").ok();
+    }
+};
+
+// %cQE,<macro>%c
+template<> struct FlexDCCommand<CMD_HOME_MACRO> {
+    static bool encode(FlexDCCommandBuffer &out, char axis, const char *macro) {
+        return out.put(axis).put("QE,").puts(macro).put(axis).ok();
+    }
+};
+
+// %c<array>[%d]=%ld
+template<> struct FlexDCCommand<CMD_ARRAY_SET> {
+    static bool encode(FlexDCCommandBuffer &out, char axis, const char *array, int index, long value) {
+        return out.put(axis).puts(array).put('[').put(index).put("]=").put(value).ok();
+    }
+};
+
+// %c<array>[%d]
+template<> struct FlexDCCommand<CMD_ARRAY_GET> {
+    static bool encode(FlexDCCommandBuffer &out, char axis, const char *array, int index) {
+        return out.put(axis).puts(array).put('[').put(index).put(']').ok();
+    }
+};
+
+// %cMP[1]=%d;%cMP[2]=%d;%cMP[3]=0;%cPT=1
+template<> struct FlexDCCommand<CMD_PROFILE_START> {
+    static bool encode(FlexDCCommandBuffer &out, char axis, int first, int last) {
+        return out.put(axis).put("MP[1]=").put(first).put(';').put(axis).put("MP[2]=").put(last)
+                  .put(';').put(axis).put("MP[3]=0;").put(axis).put("PT=1").ok();
+    }
+};
+
+// %cRR=0;%cRC=7;%cRG=%d;%cRL=%d;%cRR=2
+template<> struct FlexDCCommand<CMD_RECORDER_ARM> {
+    static bool encode(FlexDCCommandBuffer &out, char axis, int gap, int length) {
+        return out.put(axis).put("RR=0;").put(axis).put("RC=7;").put(axis).put("RG=").put(gap)
+                  .put(';').put(axis).put("RL=").put(length).put(';').put(axis).put("RR=2").ok();
+    }
+};
+
+// %cTR[1]=%d;%cTR[2]=%d
+template<> struct FlexDCCommand<CMD_SETTLE_WINDOW> {
+    static bool encode(FlexDCCommandBuffer &out, char axis, int window, int settle_time) {
+        return out.put(axis).put("TR[1]=").put(window).put(';').put(axis).put("TR[2]=").put(settle_time).ok();
+    }
+};
+
+// %cPA[90]=%ld
+template<> struct FlexDCCommand<CMD_SNAPSHOT_TOKEN> {
+    static bool encode(FlexDCCommandBuffer &out, char axis, long token) {
+        return out.put(axis).put("PA[90]=").put(token).ok();
+    }
+};
+
+// %c<query>, for all argument-less queries (the axis letter placeholder is skipped from format)
+inline bool encodeAxisQuery(FlexDCCommandBuffer &out, char axis, const char *format) {
+    return out.put(axis).puts(format+2).ok();
+}
+
+#endif // _FLEXDCCOMMANDENCODER_H_
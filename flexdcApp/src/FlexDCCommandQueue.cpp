@@ -0,0 +1,491 @@
+/*
+FILENAME...   FlexDCCommandQueue.cpp
+USAGE...      Pipelined command queue for the Nanomotion FlexDC controller
+
+Jose G.C. Gabadinho
+April 2021
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "FlexDCCommandQueue.h"
+
+#include <epicsThread.h>
+
+#include <asynOctetSyncIO.h>
+
+
+
+static const char *driverName = "NanomotionFlexDC";
+
+static void ioThreadC(void *pPvt) {
+    FlexDCCommandQueue *p_queue = static_cast<FlexDCCommandQueue*>(pPvt);
+    p_queue->ioThread();
+}
+
+/** Creates a new FlexDCCommandQueue object and starts its I/O thread.
+  * The I/O thread is the only user of the octet connection: it writes up to FLEXDC_PIPELINE_DEPTH
+  * queued commands back-to-back, then reads their replies in order, each terminated by the input EOS.
+  *
+  * \param[in] name       Name of the owner asyn port, used to name the I/O thread
+  * \param[in] pasynUser  asynUser connected to the FlexDC controller octet port (can be NULL)
+  */
+FlexDCCommandQueue::FlexDCCommandQueue(const char *name, asynUser *pasynUser): pasynUser(pasynUser) {
+    char thread_name[64];
+    int req;
+
+    this->freeList = NULL;
+    for (req=FLEXDC_QUEUE_SIZE-1; req>=0; req--) {
+        this->requests[req].done = epicsEventMustCreate(epicsEventEmpty);
+        this->requests[req].next = this->freeList;
+        this->freeList = &this->requests[req];
+    }
+    this->pendingHead = NULL;
+    this->pendingTail = NULL;
+
+    this->lastPriorityLatency = 0.0;
+    this->maxPriorityLatency = 0.0;
+    this->consecutiveFailures = 0;
+
+    this->mutex = epicsMutexMustCreate();
+    this->workEvent = epicsEventMustCreate(epicsEventEmpty);
+
+    snprintf(thread_name, sizeof(thread_name), "FlexDCIO_%s", name);
+    epicsThreadCreate(thread_name, epicsThreadPriorityMedium, epicsThreadGetStackSize(epicsThreadStackMedium), ioThreadC, this);
+}
+
+/** Queues a command for the I/O thread.
+  * A priority request jumps ahead of all pending queries, but never ahead of a command queued before it
+  * (so that a stop cannot be overtaken by an earlier move).
+  *
+  * \param[in] command   The command string, without output EOS
+  * \param[in] waited    true if the caller will wait() and release() the request, false to have it released once sent
+  * \param[in] timeout   Timeout of the reply read
+  * \param[in] priority  true to jump ahead of pending queries
+  * \param[in] origin    When the action that triggered this request started, to measure its latency (can be NULL)
+  *
+  * \return The queued request, or NULL if the queue is full
+  */
+FlexDCRequest* FlexDCCommandQueue::post(const char *command, bool waited, double timeout, bool priority, const epicsTimeStamp *origin) {
+    FlexDCRequest *request, *previous, *node;
+
+    epicsMutexMustLock(this->mutex);
+    request = this->freeList;
+    if (request) {
+        this->freeList = request->next;
+
+        strncpy(request->command, command, MAX_CONTROLLER_STRING_SIZE-1);
+        request->command[MAX_CONTROLLER_STRING_SIZE-1] = '\0';
+        request->reply[0] = '\0';
+        request->status = asynSuccess;
+        request->timeout = timeout;
+        request->waited = waited;
+        request->priority = priority;
+        if (origin) {
+            request->origin = *origin;
+        } else {
+            epicsTimeGetCurrent(&request->origin);
+        }
+        request->next = NULL;
+
+        previous = this->pendingTail;
+        if (priority) {
+            // Insert after the last pending command or priority request
+            previous = NULL;
+            for (node=this->pendingHead; node; node=node->next) {
+                if ((!node->waited) || (node->priority)) {
+                    previous = node;
+                }
+            }
+        }
+
+        if (previous) {
+            request->next = previous->next;
+            previous->next = request;
+        } else {
+            request->next = this->pendingHead;
+            this->pendingHead = request;
+        }
+        if (!request->next) {
+            this->pendingTail = request;
+        }
+    }
+    epicsMutexUnlock(this->mutex);
+
+    if (request) {
+        epicsEventSignal(this->workEvent);
+    } else {
+        log(ASYN_TRACE_ERROR, "%s: FlexDC command queue is full, dropping %s\n", driverName, command);
+    }
+
+    return request;
+}
+
+/** Waits until the I/O thread has sent a request and read its reply.
+  * Safe to call without any lock held.
+  *
+  * \param[in] request  A request posted with waited set to true
+  */
+void FlexDCCommandQueue::wait(FlexDCRequest *request) {
+    epicsEventMustWait(request->done);
+}
+
+/** Retrieves the reply of a completed request and returns it to the free list.
+  *
+  * \param[in]  request     A request posted with waited set to true, after wait()
+  * \param[out] reply       Where to copy the reply (can be NULL)
+  * \param[in]  reply_size  Size of reply
+  *
+  * \return Status of the request write/read: asynTimeout if it was written but its reply not read, so that it may have run
+  */
+asynStatus FlexDCCommandQueue::release(FlexDCRequest *request, char *reply, size_t reply_size) {
+    asynStatus status = request->status;
+
+    if ((reply) && (reply_size)) {
+        strncpy(reply, request->reply, reply_size-1);
+        reply[reply_size-1] = '\0';
+    }
+
+    epicsMutexMustLock(this->mutex);
+    request->next = this->freeList;
+    this->freeList = request;
+    epicsMutexUnlock(this->mutex);
+
+    return status;
+}
+
+/** Queues a command and returns without waiting for it to be sent.
+  *
+  * \param[in] command  The command string, without output EOS
+  * \param[in] timeout  Timeout of the acknowledgement read
+  *
+  * \return asynSuccess if queued, asynError if the queue is full
+  */
+asynStatus FlexDCCommandQueue::send(const char *command, double timeout) {
+    return post(command, false, timeout) ? asynSuccess : asynError;
+}
+
+/** Queues a command ahead of any pending query, and returns without waiting for it to be sent.
+  *
+  * \param[in] command  The command string, without output EOS
+  * \param[in] timeout  Timeout of the acknowledgement read
+  * \param[in] origin   When the action that triggered this command started (can be NULL)
+  *
+  * \return asynSuccess if queued, asynError if the queue is full
+  */
+asynStatus FlexDCCommandQueue::sendPriority(const char *command, double timeout, const epicsTimeStamp *origin) {
+    return post(command, false, timeout, true, origin) ? asynSuccess : asynError;
+}
+
+/** Retrieves the time, in seconds, between the origin of priority requests and their write to the controller.
+  *
+  * \param[out] last  Latency of the last priority request
+  * \param[out] max   Largest latency so far
+  */
+void FlexDCCommandQueue::getPriorityLatency(double *last, double *max) {
+    epicsMutexMustLock(this->mutex);
+    *last = this->lastPriorityLatency;
+    *max = this->maxPriorityLatency;
+    epicsMutexUnlock(this->mutex);
+}
+
+/** Number of transfers that failed in a row, since the last one that succeeded.
+  * A transfer is one pipelined batch of requests, and counts once however many of its requests failed.
+  *
+  */
+int FlexDCCommandQueue::getConsecutiveFailures() {
+    int failures;
+
+    epicsMutexMustLock(this->mutex);
+    failures = this->consecutiveFailures;
+    epicsMutexUnlock(this->mutex);
+
+    return failures;
+}
+
+/** Body of the I/O thread.
+  *
+  */
+void FlexDCCommandQueue::ioThread() {
+    FlexDCRequest *in_flight[FLEXDC_PIPELINE_DEPTH];
+    int num_requests;
+
+    while (true) {
+        epicsEventMustWait(this->workEvent);
+
+        while ((num_requests = takePending(in_flight, FLEXDC_PIPELINE_DEPTH))) {
+            process(in_flight, num_requests);
+        }
+    }
+}
+
+/** Transfers a batch of requests taken from the pending list, then completes them.
+  *
+  */
+void FlexDCCommandQueue::process(FlexDCRequest **requests, int num_requests) {
+    int req;
+
+    transfer(requests, num_requests);
+    updateFailures(requests, num_requests);
+
+    for (req=0; req<num_requests; req++) {
+        complete(requests[req]);
+    }
+}
+
+/** Removes, in order, up to max_requests requests from the pending list.
+  *
+  * \return Number of requests taken
+  */
+int FlexDCCommandQueue::takePending(FlexDCRequest **requests, int max_requests) {
+    int num_requests = 0;
+
+    epicsMutexMustLock(this->mutex);
+    while ((this->pendingHead) && (num_requests < max_requests)) {
+        requests[num_requests++] = this->pendingHead;
+        this->pendingHead = this->pendingHead->next;
+    }
+    if (!this->pendingHead) {
+        this->pendingTail = NULL;
+    }
+    epicsMutexUnlock(this->mutex);
+
+    return num_requests;
+}
+
+/** Writes all commands, then reads all replies in the same order.
+  * If a reply cannot be read, the remaining replies are considered lost and the input is flushed before the next transfer.
+  * The commands written after it may still have run on the controller: their outcome is unknown, and they complete with asynTimeout.
+  * A reply arriving only after that flush is read as the reply to the first request of the next transfer.
+  *
+  */
+void FlexDCCommandQueue::transfer(FlexDCRequest **requests, int num_requests) {
+    size_t n_written, n_read;
+    int eom_reason, req;
+    asynStatus status = asynSuccess;
+
+    if (!this->pasynUser) {
+        for (req=0; req<num_requests; req++) {
+            requests[req]->status = asynDisconnected;
+        }
+        return;
+    }
+
+    // Discard anything left over from a previous desynchronized exchange
+    pasynOctetSyncIO->flush(this->pasynUser);
+
+    for (req=0; req<num_requests; req++) {
+        requests[req]->status = pasynOctetSyncIO->write(this->pasynUser, requests[req]->command, strlen(requests[req]->command), requests[req]->timeout, &n_written);
+        epicsTimeGetCurrent(&requests[req]->sent);
+        if ((requests[req]->priority) && (requests[req]->status == asynSuccess)) {
+            updatePriorityLatency(requests[req]);
+        }
+    }
+
+    for (req=0; req<num_requests; req++) {
+        if (requests[req]->status != asynSuccess) {
+            continue;
+        }
+        if (status == asynSuccess) {
+            status = pasynOctetSyncIO->read(this->pasynUser, requests[req]->reply, MAX_CONTROLLER_STRING_SIZE-1, requests[req]->timeout, &n_read, &eom_reason);
+            if (status == asynSuccess) {
+                requests[req]->reply[n_read] = '\0';
+                updateLatency(requests[req]);
+            } else {
+                log(ASYN_TRACE_ERROR, "%s: no reply from FlexDC to %s\n", driverName, requests[req]->command);
+            }
+            requests[req]->status = status;
+        } else {
+            requests[req]->status = asynTimeout;
+        }
+    }
+}
+
+/** Counts the transfers that failed in a row, for the connection supervision of the controller.
+  * A single slow reply fails all the requests pipelined after it, but only counts as one failure.
+  *
+  */
+void FlexDCCommandQueue::updateFailures(FlexDCRequest **requests, int num_requests) {
+    bool failed = false;
+    int req;
+
+    for (req=0; req<num_requests; req++) {
+        failed = failed || (requests[req]->status != asynSuccess);
+    }
+
+    epicsMutexMustLock(this->mutex);
+    if (failed) {
+        this->consecutiveFailures++;
+    } else {
+        this->consecutiveFailures = 0;
+    }
+    epicsMutexUnlock(this->mutex);
+}
+
+/** Accounts for the latency of a priority request that was just written.
+  *
+  */
+void FlexDCCommandQueue::updatePriorityLatency(FlexDCRequest *request) {
+    epicsTimeStamp now;
+    double latency;
+
+    epicsTimeGetCurrent(&now);
+    latency = epicsTimeDiffInSeconds(&now, &request->origin);
+
+    epicsMutexMustLock(this->mutex);
+    this->lastPriorityLatency = latency;
+    if (latency > this->maxPriorityLatency) {
+        this->maxPriorityLatency = latency;
+    }
+    epicsMutexUnlock(this->mutex);
+}
+
+/** Accounts for the time between the write of a request and the read of its reply, by kind of exchange.
+  * With pipelining, this includes the time spent reading the replies of the requests written before it.
+  * A batch of queries is also accounted once to each kind of polled query it carries, with the latency of the whole batch,
+  * so that those kinds are filled in the batched poll modes too.
+  *
+  */
+void FlexDCCommandQueue::updateLatency(FlexDCRequest *request) {
+    epicsTimeStamp now;
+    flexdcExchangeKind kind = classify(request->command);
+    unsigned int batch_kinds = (kind == EXCH_BATCH) ? classifyBatch(request->command) : 0;
+    double latency;
+    int query;
+
+    epicsTimeGetCurrent(&now);
+    latency = epicsTimeDiffInSeconds(&now, &request->sent);
+
+    epicsMutexMustLock(this->mutex);
+    this->latency[kind].add(latency);
+    for (query=EXCH_PS; query<=EXCH_MF; query++) {
+        if (batch_kinds & (1u << query)) this->latency[query].add(latency);
+    }
+    epicsMutexUnlock(this->mutex);
+}
+
+/** Copies the latency histograms of all exchange kinds.
+  *
+  * \param[out] histograms  NUM_EXCHANGE_KINDS histograms, in flexdcExchangeKind order
+  */
+void FlexDCCommandQueue::getLatency(FlexDCLatencyHistogram *histograms) {
+    int kind;
+
+    epicsMutexMustLock(this->mutex);
+    for (kind=0; kind<NUM_EXCHANGE_KINDS; kind++) {
+        histograms[kind] = this->latency[kind];
+    }
+    epicsMutexUnlock(this->mutex);
+}
+
+/** Clears the latency histograms and the largest priority latency.
+  *
+  */
+void FlexDCCommandQueue::resetLatency() {
+    int kind;
+
+    epicsMutexMustLock(this->mutex);
+    for (kind=0; kind<NUM_EXCHANGE_KINDS; kind++) {
+        this->latency[kind].clear();
+    }
+    this->maxPriorityLatency = this->lastPriorityLatency;
+    epicsMutexUnlock(this->mutex);
+}
+
+/** Tells the kind of an exchange from its command: a move (anything ending with a begin), a stop, a batch of several queries,
+  * one of the polled queries, or anything else.
+  *
+  * \param[in] command  The command string
+  *
+  * \return Kind of exchange
+  */
+flexdcExchangeKind FlexDCCommandQueue::classify(const char *command) {
+    size_t len = strlen(command);
+
+    if ((len >= 3) && (!strcmp(command+len-2, "BG"))) {
+        return EXCH_MOVE;
+    }
+    if ((len == 3) && (!strcmp(command+1, "ST"))) {
+        return EXCH_STOP;
+    }
+    if (strchr(command, ';')) {
+        return EXCH_BATCH;
+    }
+    return classifyQuery(command, len);
+}
+
+/** Tells the kinds of polled queries carried by a batch of queries.
+  *
+  * \param[in] command  The command string, queries separated by ';'
+  *
+  * \return Bit mask of the flexdcExchangeKind of the polled queries found (1 << kind), 0 if none
+  */
+unsigned int FlexDCCommandQueue::classifyBatch(const char *command) {
+    unsigned int kinds = 0;
+    const char *end;
+    flexdcExchangeKind kind;
+
+    while (true) {
+        end = strchr(command, ';');
+        if (!end) end = command+strlen(command);
+
+        kind = classifyQuery(command, end-command);
+        if (kind != EXCH_OTHER) kinds |= 1u << kind;
+
+        if (!*end) break;
+        command = end+1;
+    }
+
+    return kinds;
+}
+
+/** Tells which polled query a single query is, e.g. XPS or YPA[11].
+  *
+  * \param[in] query  The query, not necessarily null-terminated
+  * \param[in] len    Length of the query
+  *
+  * \return Kind of polled query, or EXCH_OTHER
+  */
+flexdcExchangeKind FlexDCCommandQueue::classifyQuery(const char *query, size_t len) {
+    static const char *queries[] = { "PS", "MO", "MS", "PA[11]", "EM", "PE", "MF" };
+    int kind;
+
+    if (len >= 3) {
+        for (kind=0; kind<(int)(sizeof(queries)/sizeof(*queries)); kind++) {
+            if ((strlen(queries[kind]) == len-1) && (!strncmp(query+1, queries[kind], len-1))) {
+                return static_cast<flexdcExchangeKind>(EXCH_PS+kind);
+            }
+        }
+    }
+    return EXCH_OTHER;
+}
+
+/** Hands a processed request back to its waiter, or frees it.
+  *
+  */
+void FlexDCCommandQueue::complete(FlexDCRequest *request) {
+    if (request->waited) {
+        epicsEventSignal(request->done);
+    } else {
+        if (request->status == asynTimeout) {
+            log(ASYN_TRACE_WARNING, "%s: FlexDC command %s sent but not acknowledged, outcome unknown\n", driverName, request->command);
+        } else if (request->status != asynSuccess) {
+            log(ASYN_TRACE_ERROR, "%s: FlexDC command %s failed with status %d\n", driverName, request->command, request->status);
+        }
+        release(request, NULL, 0);
+    }
+}
+
+/** Provide a class method to be used instead of asynPrint().
+  *
+  */
+void FlexDCCommandQueue::log(int reason, const char *format, ...) {
+    if (this->pasynUser) {
+        va_list arglist;
+        va_start(arglist, format);
+        pasynTrace->vprint(this->pasynUser, reason, format, arglist);
+        va_end(arglist);
+    }
+}
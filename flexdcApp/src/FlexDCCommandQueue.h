@@ -0,0 +1,95 @@
+/*
+FILENAME...   FlexDCCommandQueue.h
+USAGE...      Pipelined command queue for the Nanomotion FlexDC controller
+
+Jose G.C. Gabadinho
+April 2021
+*/
+
+#ifndef _FLEXDCCOMMANDQUEUE_H_
+#define _FLEXDCCOMMANDQUEUE_H_
+
+#include <asynMotorController.h>
+
+#include <epicsEvent.h>
+#include <epicsMutex.h>
+#include <epicsTime.h>
+
+#include "FlexDCLatencyStats.h"
+
+
+
+#define FLEXDC_QUEUE_SIZE     32
+#define FLEXDC_PIPELINE_DEPTH 8
+
+
+
+struct FlexDCRequest {
+    char command[MAX_CONTROLLER_STRING_SIZE];
+    char reply[MAX_CONTROLLER_STRING_SIZE];
+    asynStatus status;
+    double timeout;
+    bool waited;
+    bool priority;
+    epicsTimeStamp origin;
+    epicsTimeStamp sent;
+    epicsEventId done;
+    FlexDCRequest *next;
+};
+
+
+
+class FlexDCCommandQueue {
+
+public:
+    FlexDCCommandQueue(const char *name, asynUser *pasynUser);
+
+    FlexDCRequest* post(const char *command, bool waited, double timeout, bool priority=false, const epicsTimeStamp *origin=NULL);
+    void wait(FlexDCRequest *request);
+    asynStatus release(FlexDCRequest *request, char *reply, size_t reply_size);
+
+    asynStatus send(const char *command, double timeout);
+    asynStatus sendPriority(const char *command, double timeout, const epicsTimeStamp *origin);
+
+    void getPriorityLatency(double *last, double *max);
+    void getLatency(FlexDCLatencyHistogram *histograms);
+    void resetLatency();
+
+    int getConsecutiveFailures();
+
+    static flexdcExchangeKind classify(const char *command);
+    static unsigned int classifyBatch(const char *command);
+
+    void ioThread();
+
+protected:
+    virtual int takePending(FlexDCRequest **requests, int max_requests);
+    virtual void process(FlexDCRequest **requests, int num_requests);
+    virtual void transfer(FlexDCRequest **requests, int num_requests);
+    virtual void complete(FlexDCRequest *request);
+    virtual void updatePriorityLatency(FlexDCRequest *request);
+    virtual void updateLatency(FlexDCRequest *request);
+    virtual void updateFailures(FlexDCRequest **requests, int num_requests);
+
+    virtual void log(int reason, const char *format, ...);
+
+    static flexdcExchangeKind classifyQuery(const char *query, size_t len);
+
+    asynUser *pasynUser;
+
+private:
+    FlexDCRequest requests[FLEXDC_QUEUE_SIZE];
+    FlexDCRequest *freeList;
+    FlexDCRequest *pendingHead;
+    FlexDCRequest *pendingTail;
+
+    double lastPriorityLatency;
+    double maxPriorityLatency;
+    FlexDCLatencyHistogram latency[NUM_EXCHANGE_KINDS];
+    int consecutiveFailures;
+
+    epicsMutexId mutex;
+    epicsEventId workEvent;
+};
+
+#endif // _FLEXDCCOMMANDQUEUE_H_
@@ -0,0 +1,231 @@
+/*
+FILENAME...   FlexDCLatencyStats.h
+USAGE...      Latency histograms of the exchanges with the Nanomotion FlexDC controller, and rolling duration statistics
+
+Jose G.C. Gabadinho
+April 2021
+*/
+
+#ifndef _FLEXDCLATENCYSTATS_H_
+#define _FLEXDCLATENCYSTATS_H_
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <epicsTypes.h>
+
+
+
+// Bucket b counts latencies from 2^b to 2^(b+1) us (the first also below 1 us, the last also above)
+#define FLEXDC_LATENCY_BUCKETS 21
+
+// Number of most recent durations kept by FlexDCRollingStats
+#define FLEXDC_ROLLING_SAMPLES 128
+
+
+
+/** Exchange kinds, as told apart from the command text by FlexDCCommandQueue::classify().
+  *
+  */
+enum flexdcExchangeKind {
+    EXCH_PS,
+    EXCH_MO,
+    EXCH_MS,
+    EXCH_PA,
+    EXCH_EM,
+    EXCH_PE,
+    EXCH_MF,
+    EXCH_MOVE,
+    EXCH_STOP,
+    EXCH_BATCH,
+    EXCH_OTHER,
+    NUM_EXCHANGE_KINDS
+};
+
+const char* const EXCHANGE_KIND_NAMES[] = {
+    "PS",
+    "MO",
+    "MS",
+    "PA",
+    "EM",
+    "PE",
+    "MF",
+    "move",
+    "stop",
+    "batch",
+    "other"
+};
+
+
+
+/** Log2 histogram of durations, with their count, sum and maximum.
+  * Not thread-safe: the owner serializes its updates and copies.
+  */
+class FlexDCLatencyHistogram {
+
+public:
+    FlexDCLatencyHistogram() {
+        clear();
+    }
+
+    void clear() {
+        memset(this->buckets, 0, sizeof(this->buckets));
+        this->count = 0;
+        this->sum = 0.0;
+        this->max = 0.0;
+    }
+
+    /** Accounts for a duration.
+      *
+      * \param[in] seconds  The duration, in seconds
+      */
+    void add(double seconds) {
+        this->buckets[bucket(seconds)]++;
+        this->count++;
+        this->sum += seconds;
+        if (seconds > this->max) {
+            this->max = seconds;
+        }
+    }
+
+    /** Adds up the durations of another histogram into this one.
+      *
+      */
+    void merge(const FlexDCLatencyHistogram &other) {
+        int b;
+
+        for (b=0; b<FLEXDC_LATENCY_BUCKETS; b++) {
+            this->buckets[b] += other.buckets[b];
+        }
+        this->count += other.count;
+        this->sum += other.sum;
+        if (other.max > this->max) {
+            this->max = other.max;
+        }
+    }
+
+    double mean() const {
+        return this->count ? this->sum/this->count : 0.0;
+    }
+
+    /** Prints the non-empty buckets, one per line.
+      *
+      * \param[in] fp     Where to print
+      * \param[in] label  What was measured
+      */
+    void print(FILE *fp, const char *label) const {
+        int b;
+
+        fprintf(fp, "    %-6s count=%lu mean=%.3f ms max=%.3f ms\n", label, (unsigned long)this->count, mean()*1000., this->max*1000.);
+        for (b=0; b<FLEXDC_LATENCY_BUCKETS; b++) {
+            if (!this->buckets[b]) continue;
+            if (b == FLEXDC_LATENCY_BUCKETS-1) {
+                fprintf(fp, "      >=%8lu us: %lu\n", 1UL << b, (unsigned long)this->buckets[b]);
+            } else {
+                fprintf(fp, "      < %8lu us: %lu\n", 2UL << b, (unsigned long)this->buckets[b]);
+            }
+        }
+    }
+
+    static int bucket(double seconds) {
+        double limit = 2e-6;
+        int b;
+
+        for (b=0; (b < FLEXDC_LATENCY_BUCKETS-1) && (seconds >= limit); b++) {
+            limit *= 2.;
+        }
+        return b;
+    }
+
+    epicsUInt32 buckets[FLEXDC_LATENCY_BUCKETS];
+    epicsUInt32 count;
+    double sum;
+    double max;
+};
+
+
+
+/** Minimum, mean and percentiles of the last FLEXDC_ROLLING_SAMPLES durations.
+  * Not thread-safe: the owner serializes its updates and reads.
+  */
+class FlexDCRollingStats {
+
+public:
+    FlexDCRollingStats() {
+        clear();
+    }
+
+    void clear() {
+        this->next = 0;
+        this->count = 0;
+    }
+
+    /** Accounts for a duration, forgetting the oldest one if full.
+      *
+      * \param[in] seconds  The duration, in seconds
+      */
+    void add(double seconds) {
+        this->samples[this->next] = seconds;
+        this->next = (this->next+1) % FLEXDC_ROLLING_SAMPLES;
+        if (this->count < FLEXDC_ROLLING_SAMPLES) {
+            this->count++;
+        }
+    }
+
+    double min() const {
+        double result = this->count ? this->samples[0] : 0.0;
+        int sample;
+
+        for (sample=1; sample<this->count; sample++) {
+            if (this->samples[sample] < result) result = this->samples[sample];
+        }
+        return result;
+    }
+
+    double mean() const {
+        double sum = 0.0;
+        int sample;
+
+        for (sample=0; sample<this->count; sample++) {
+            sum += this->samples[sample];
+        }
+        return this->count ? sum/this->count : 0.0;
+    }
+
+    /** Nearest-rank percentile of the kept durations.
+      *
+      * \param[in] fraction  The percentile, from 0 to 1 (e.g. 0.99)
+      *
+      * \return The smallest duration not exceeded by that fraction of the durations, 0 if none
+      */
+    double percentile(double fraction) const {
+        double sorted[FLEXDC_ROLLING_SAMPLES];
+        int rank;
+
+        if (!this->count) {
+            return 0.0;
+        }
+        memcpy(sorted, this->samples, this->count*sizeof(double));
+        qsort(sorted, this->count, sizeof(double), compare);
+
+        rank = (int)ceil(fraction*this->count - 1e-9);
+        if (rank < 1) rank = 1;
+        if (rank > this->count) rank = this->count;
+        return sorted[rank-1];
+    }
+
+    int count;
+
+private:
+    static int compare(const void *first, const void *second) {
+        double a = *(const double *)first, b = *(const double *)second;
+        return (a > b) - (a < b);
+    }
+
+    double samples[FLEXDC_ROLLING_SAMPLES];
+    int next;
+};
+
+#endif // _FLEXDCLATENCYSTATS_H_
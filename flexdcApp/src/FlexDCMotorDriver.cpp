@@ -13,11 +13,14 @@ April 2021
 #include <stdarg.h>
 
 #include "FlexDCMotorDriver.h"
+#include "FlexDCCommandEncoder.h"
 
 #include <iocsh.h>
 #include <epicsThread.h>
+#include <errlog.h>
 
 #include <asynOctetSyncIO.h>
+#include <asynCommonSyncIO.h>
 
 #include <epicsExport.h>
 #include <epicsThread.h>
@@ -52,38 +55,56 @@ const char* MACRO_RESULT[] = {
 
 const char* HOMR_MACRO[] = {
     "",
-    "%cQE,#HINRI%c",
-    "%cQE,#HINX_%c"
+    "#HINRI",
+    "#HINX_"
 };
 const char* HOMF_MACRO[] = {
     "",
-    "%cQE,#HINFI%c",
-    "%cQE,#HINX_%c"
+    "#HINFI",
+    "#HINX_"
 };
 
 
 
 static const char *driverName = "NanomotionFlexDC";
 
+static void captureThreadC(void *pPvt) {
+    FlexDCController *p_controller = static_cast<FlexDCController*>(pPvt);
+    p_controller->captureThread();
+}
+
+static void linkThreadC(void *pPvt) {
+    FlexDCController *p_controller = static_cast<FlexDCController*>(pPvt);
+    p_controller->linkThread();
+}
+
+static void recorderThreadC(void *pPvt) {
+    FlexDCController *p_controller = static_cast<FlexDCController*>(pPvt);
+    p_controller->recorderThread();
+}
+
 /** Creates a new FlexDCController object.
+  * Several FlexDC units can be driven by a single port: each has its own connection and I/O thread,
+  * and brings CTRL_NUM_AXES axes, numbered in the order the units are listed.
   *
   * \param[in] portName          The name of the asyn port that will be created for this driver
-  * \param[in] asynPortName      The name of the drvAsynIPPPort that was created previously to connect to the Flex DC controller
-  * \param[in] numAxes           The number of axes that this controller supports (discarded and overwritten to 2)
+  * \param[in] asynPortName      The name of the drvAsynIPPPort that was created previously to connect to the Flex DC controller,
+  *                              or a CTRL_UNIT_SEPARATOR-separated list of them to drive several units
+  * \param[in] numAxes           The number of axes that this controller supports (discarded and overwritten to all axes of all units)
   * \param[in] movingPollPeriod  The time between polls when any axis is moving
   * \param[in] idlePollPeriod    The time between polls when no axis is moving
+  * \param[in] snapshotFile      Where to save the axes state to restore at the next startup (NULL or empty to disable)
   */
-FlexDCController::FlexDCController(const char *portName, const char *asynPortName, int numAxes, double movingPollPeriod, double idlePollPeriod)
-    :asynMotorController(portName, 2, NUM_FLEXDC_PARAMS, 
+FlexDCController::FlexDCController(const char *portName, const char *asynPortName, int numAxes, double movingPollPeriod, double idlePollPeriod, const char *snapshotFile)
+    :asynMotorController(portName, countUnits(asynPortName)*CTRL_NUM_AXES, NUM_FLEXDC_PARAMS, 
                          0,
                          0,
                          ASYN_CANBLOCK | ASYN_MULTIDEVICE, 
                          1, /* autoconnect */
                          0, 0) /* Default priority and stack size */ {
-    int axis;
-    asynStatus status;
-    char eos[10];
-    int eos_len;
+    int axis, unit;
+    const char *name, *name_end;
+    char queue_name[80];
     static const char *functionName = "FlexDCController";
 
     createParam(AXIS_MRES_PARAMNAME, asynParamFloat64, &driverMotorRecResolution);
@@ -92,78 +113,1705 @@ FlexDCController::FlexDCController(const char *portName, const char *asynPortNam
     createParam(AXIS_HOMF_PARAMNAME, asynParamInt32, &driverHomeForwardMacro);
     createParam(AXIS_HOMS_PARAMNAME, asynParamInt32, &driverHomeStatus);
     createParam(CTRL_RST_PARAMNAME,  asynParamInt32, &driverResetController);
+    createParam(CTRL_HOMALL_PARAMNAME, asynParamInt32, &driverHomeAll);
+    createParam(CTRL_POLL_PARAMNAME, asynParamInt32, &driverPollMode);
+    createParam(CTRL_STPLAT_PARAMNAME, asynParamFloat64, &driverStopLatency);
+    createParam(CTRL_STPMAX_PARAMNAME, asynParamFloat64, &driverStopLatencyMax);
+    createParam(AXIS_SPOLL_PARAMNAME, asynParamFloat64, &driverSettlePollPeriod);
+    createParam(AXIS_PPOLL_PARAMNAME, asynParamFloat64, &driverParkedPollPeriod);
+    createParam(AXIS_HPOLL_PARAMNAME, asynParamFloat64, &driverHomePollPeriod);
+    createParam(AXIS_HOMSTG_PARAMNAME, asynParamInt32,  &driverHomeStage);
+    createParam(AXIS_SWIN_PARAMNAME,  asynParamInt32,   &driverSettleWindow);
+    createParam(AXIS_STPTMO_PARAMNAME, asynParamFloat64, &driverStopTimeout);
+    createParam(AXIS_SUPP_PARAMNAME, asynParamInt32, &driverSuppressedUpdates);
+    createParam(AXIS_SETTLEMODE_PARAMNAME, asynParamInt32,   &driverSettleMode);
+    createParam(AXIS_SETTLETIME_PARAMNAME, asynParamFloat64, &driverSettleTime);
+    createParam(AXIS_PHASEMIN_PARAMNAME,   asynParamFloat64Array, &driverPhaseMin);
+    createParam(AXIS_PHASEMEAN_PARAMNAME,  asynParamFloat64Array, &driverPhaseMean);
+    createParam(AXIS_PHASEP99_PARAMNAME,   asynParamFloat64Array, &driverPhaseP99);
+    createParam(AXIS_PHASECOUNT_PARAMNAME, asynParamFloat64Array, &driverPhaseCount);
+    createParam(CTRL_UPRATE_PARAMNAME, asynParamFloat64, &driverUploadRate);
+    createParam(AXIS_CAPT_PARAMNAME,     asynParamInt32,        &driverCapture);
+    createParam(AXIS_CAPTDEC_PARAMNAME,  asynParamInt32,        &driverCaptureDecimation);
+    createParam(AXIS_CAPTPOS_PARAMNAME,  asynParamFloat64Array, &driverCapturePositions);
+    createParam(AXIS_CAPTERR_PARAMNAME,  asynParamFloat64Array, &driverCaptureErrors);
+    createParam(AXIS_CAPTTIME_PARAMNAME, asynParamFloat64Array, &driverCaptureTimes);
+    createParam(AXIS_CAPTDROP_PARAMNAME, asynParamInt32,        &driverCaptureDropped);
+    createParam(CTRL_CAPTPER_PARAMNAME,  asynParamFloat64,      &driverCapturePeriod);
+    createParam(AXIS_RECARM_PARAMNAME,  asynParamInt32,        &driverRecorderArm);
+    createParam(AXIS_RECSTAT_PARAMNAME, asynParamInt32,        &driverRecorderState);
+    createParam(AXIS_RECLEN_PARAMNAME,  asynParamInt32,        &driverRecorderLength);
+    createParam(AXIS_RECGAP_PARAMNAME,  asynParamInt32,        &driverRecorderGap);
+    createParam(AXIS_RECPOS_PARAMNAME,  asynParamFloat64Array, &driverRecordPositions);
+    createParam(AXIS_RECERR_PARAMNAME,  asynParamFloat64Array, &driverRecordErrors);
+    createParam(AXIS_RECCUR_PARAMNAME,  asynParamFloat64Array, &driverRecordCurrents);
+    createParam(AXIS_RECTIME_PARAMNAME, asynParamFloat64Array, &driverRecordTimes);
+    createParam(CTRL_LATMEAN_PARAMNAME,  asynParamFloat64Array, &driverLatencyMean);
+    createParam(CTRL_LATMAX_PARAMNAME,   asynParamFloat64Array, &driverLatencyMax);
+    createParam(CTRL_LATCOUNT_PARAMNAME, asynParamFloat64Array, &driverLatencyCount);
+    createParam(CTRL_CYCLE_PARAMNAME,    asynParamFloat64,      &driverPollCycle);
+    createParam(CTRL_CYCLEMAX_PARAMNAME, asynParamFloat64,      &driverPollCycleMax);
+    createParam(CTRL_OVERRUN_PARAMNAME,  asynParamInt32,        &driverPollOverruns);
+    createParam(CTRL_STATRST_PARAMNAME,  asynParamInt32,        &driverStatsReset);
+    createParam(CTRL_LINK_PARAMNAME,     asynParamInt32,        &driverLinkUp);
+    createParam(CTRL_RECONN_PARAMNAME,   asynParamInt32,        &driverReconnects);
+
+    this->pollMode = POLL_AXIS_BATCH;
+    this->movesDeferred = false;
+    this->profilePointTimes = NULL;
+    this->profileCapturedPoints = 0;
+    this->profileExecuting = false;
+    epicsTimeGetCurrent(&this->pollCycleStart);
+    this->pollCycleMoving = false;
+    this->lastPollCycle = 0.0;
+    this->pollOverruns = 0;
+    this->lastStatsPublishTime = this->pollCycleStart;
+    snprintf(this->snapshotPath, sizeof(this->snapshotPath), "%s", snapshotFile ? snapshotFile : "");
+    memset(this->snapshotAxes, 0, sizeof(this->snapshotAxes));
+    memset(this->pendingSnapshot, 0, sizeof(this->pendingSnapshot));
+    this->snapshotQueued = false;
+    this->snapshotToken = 0;
+    this->lastSnapshotTime = this->pollCycleStart;
+    this->snapshotFailed = false;
+
+    this->numUnits = countUnits(asynPortName);
+    numAxes = this->numUnits*CTRL_NUM_AXES; // Force all axes of all units regardless of what user says
+    if (excessUnits(asynPortName)) {
+        log(ASYN_TRACE_ERROR, "%s:%s: Ignoring FlexDC %s units beyond %d: %s\n", driverName, functionName, portName, FLEXDC_MAX_UNITS, excessUnits(asynPortName));
+    }
+
+    this->units = new FlexDCUnit[this->numUnits];
+    name = asynPortName;
+    for (unit=0; unit<this->numUnits; unit++) {
+        name_end = strchr(name, CTRL_UNIT_SEPARATOR);
+        if (!name_end) name_end = name+strlen(name);
+        snprintf(this->units[unit].asynPortName, sizeof(this->units[unit].asynPortName), "%.*s", (int)(name_end-name), name);
+        name = *name_end ? name_end+1 : name_end;
+
+        // Connect to FlexDC controller
+        log(ASYN_TRACE_FLOW, "%s:%s: Creating Nanomotion FlexDC controller %s unit %d to asyn %s with %d axes\n", driverName, functionName, portName, unit, this->units[unit].asynPortName, CTRL_NUM_AXES);
+        this->units[unit].pasynUser = NULL;
+        this->units[unit].pasynUserCommon = NULL;
+        if (pasynOctetSyncIO->connect(this->units[unit].asynPortName, 0, &this->units[unit].pasynUser, NULL)) {
+            log(ASYN_TRACE_ERROR, "%s:%s: Cannot connect to Nanomotion FlexDC controller at asyn %s\n", driverName, functionName, this->units[unit].asynPortName);
+            this->units[unit].pasynUser = NULL;
+        } else {
+            setupEos(this->units[unit].pasynUser);
+
+            // Used by the connection supervisor to reconnect the unit
+            if (pasynCommonSyncIO->connect(this->units[unit].asynPortName, 0, &this->units[unit].pasynUserCommon, NULL)) {
+                log(ASYN_TRACE_ERROR, "%s:%s: Cannot supervise connection to asyn %s\n", driverName, functionName, this->units[unit].asynPortName);
+                this->units[unit].pasynUserCommon = NULL;
+            }
+        }
+
+        // All exchanges with a unit go through the I/O thread of its command queue
+        if (this->numUnits > 1) {
+            snprintf(queue_name, sizeof(queue_name), "%s:%d", portName, unit);
+        } else {
+            snprintf(queue_name, sizeof(queue_name), "%s", portName);
+        }
+        this->units[unit].commandQueue = new FlexDCCommandQueue(queue_name, this->units[unit].pasynUser);
+        this->units[unit].pollRequest = NULL;
+        this->units[unit].pollReply[0] = '\0';
+        this->units[unit].publishedStopLatency = -1.0;
+        this->units[unit].publishedStopLatencyMax = -1.0;
+        this->units[unit].linkDown = false;
+        this->units[unit].resyncPending = false;
+        this->units[unit].reconnects = 0;
+    }
+    pasynUserController_ = this->units[0].pasynUser;
+
+    this->pollFields = new char*[numAxes*NUM_POLL_FIELDS];
+    this->pollMasks = new unsigned int[numAxes];
+
+    // Create the axis objects
+    for (axis=0; axis<numAxes; axis++) {
+        new FlexDCAxis(this, axis);
+    }
+    initializeProfile(FLEXDC_MAX_PROFILE_POINTS);
+
+    if (this->snapshotPath[0]) {
+        restoreSnapshot();
+    }
+
+    // Position capture samples all units from its own thread, independently of the poller
+    this->captureEvent = epicsEventMustCreate(epicsEventEmpty);
+    snprintf(queue_name, sizeof(queue_name), "FlexDCCapture_%s", portName);
+    epicsThreadCreate(queue_name, epicsThreadPriorityHigh, epicsThreadGetStackSize(epicsThreadStackMedium), captureThreadC, this);
+
+    // Connection supervision runs on its own thread, so that reconnecting never blocks the poller
+    this->linkEvent = epicsEventMustCreate(epicsEventEmpty);
+    snprintf(queue_name, sizeof(queue_name), "FlexDCLink_%s", portName);
+    epicsThreadCreate(queue_name, epicsThreadPriorityMedium, epicsThreadGetStackSize(epicsThreadStackMedium), linkThreadC, this);
+
+    this->baseMovingPollPeriod = movingPollPeriod;
+    startPoller(movingPollPeriod, idlePollPeriod, 2);
+
+    // Recorder readouts are long downloads, kept off the poller; checked every idle poll period, set up by startPoller()
+    snprintf(queue_name, sizeof(queue_name), "FlexDCRec_%s", portName);
+    epicsThreadCreate(queue_name, epicsThreadPriorityLow, epicsThreadGetStackSize(epicsThreadStackMedium), recorderThreadC, this);
+}
+
+/** Counts the FlexDC units listed in the controller asyn port name.
+  *
+  * \param[in] asynPortNames  CTRL_UNIT_SEPARATOR-separated list of asyn port names
+  *
+  * \return Number of units, between 1 and FLEXDC_MAX_UNITS
+  */
+int FlexDCController::countUnits(const char *asynPortNames) {
+    int num_units = 1;
+
+    if (!asynPortNames) {
+        return 1;
+    }
+    for (; *asynPortNames; asynPortNames++) {
+        if (*asynPortNames == CTRL_UNIT_SEPARATOR) num_units++;
+    }
+
+    return (num_units > FLEXDC_MAX_UNITS) ? FLEXDC_MAX_UNITS : num_units;
+}
+
+/** Finds the units listed in the controller asyn port name beyond the FLEXDC_MAX_UNITS first ones.
+  *
+  * \param[in] asynPortNames  CTRL_UNIT_SEPARATOR-separated list of asyn port names
+  *
+  * \return The asyn port names of the units in excess, or NULL if none
+  */
+const char *FlexDCController::excessUnits(const char *asynPortNames) {
+    int num_units = 1;
+
+    if (!asynPortNames) {
+        return NULL;
+    }
+    for (; *asynPortNames; asynPortNames++) {
+        if (*asynPortNames != CTRL_UNIT_SEPARATOR) continue;
+        if (num_units == FLEXDC_MAX_UNITS) {
+            return asynPortNames+1;
+        }
+        num_units++;
+    }
+
+    return NULL;
+}
+
+/** Sets the FlexDC acknowledgement as input EOS, and CR LF as output EOS, unless already configured.
+  *
+  * \param[in] pasynUser  asynUser connected to a FlexDC unit
+  */
+void FlexDCController::setupEos(asynUser *pasynUser) {
+    char eos[10];
+    int eos_len;
+    static const char *functionName = "setupEos";
+
+    pasynOctetSyncIO->getInputEos(pasynUser, eos, 10, &eos_len);
+    if (!eos_len) {
+        log(ASYN_TRACE_FLOW, "%s:%s: Setting input acknowledgement of %s to '>'\n", driverName, functionName, portName);
+        pasynOctetSyncIO->setInputEos(pasynUser, ">", 1);
+    }
+
+    pasynOctetSyncIO->getOutputEos(pasynUser, eos, 10, &eos_len);
+    if (!eos_len) {
+        log(ASYN_TRACE_FLOW, "%s:%s: Setting output acknowledgement of %s to CR LF\n", driverName, functionName, portName);
+        pasynOctetSyncIO->setOutputEos(pasynUser, "\r\n", 2);
+    }
+}
+
+/** Called when asyn clients call pasynInt32->write().
+  * Extracts the function and axis number from pasynUser.
+  * Sets the value in the parameter library.
+  * If the function is motorStop_ then it calls pAxis->stop().
+  * If the function is motorUpdateStatus_ then it does a poll and forces a callback.
+  * Calls any registered callbacks for this pasynUser->reason and address.  
+  * Motor drivers will reimplement this function if they support 
+  * controller-specific parameters on the asynInt32 interface. They should call this
+  * base class method for any parameters that are not controller-specific.
+  *
+  * \param[in] pasynUser asynUser structure that encodes the reason and address.
+  * \param[in] value     Value to write.
+  *
+  * \return Result of callParamCallbacks() call or asynMotorController::writeInt32()
+  */
+asynStatus FlexDCController::writeInt32(asynUser *pasynUser, epicsInt32 value) {
+    int function = pasynUser->reason;
+    FlexDCAxis *p_axis;
+    asynStatus status = asynSuccess;
+    epicsTimeStamp reset_time;
+    int unit;
+    const char* functionName = "writeInt32";
+
+    p_axis = getAxis(pasynUser);
+    if (p_axis) {
+        if (function == driverResetController) {
+            epicsTimeGetCurrent(&reset_time);
+            p_axis->setIntegerParam(function, value);
+
+            for (unit=0; unit<this->numUnits; unit++) {
+                sprintf(this->outString_, CTRL_RESET_CMD);
+                writePriorityController(unit, &reset_time);
+            }
+
+            status = p_axis->callParamCallbacks();
+        } else if (function == driverHomeAll) {
+            p_axis->setIntegerParam(function, value);
+            status = homeAllAxes(value != 0);
+
+            p_axis->callParamCallbacks();
+        } else if (function == driverPollMode) {
+            if ((value >= POLL_SEQUENTIAL) && (value <= POLL_CONTROLLER_BATCH)) {
+                log(ASYN_TRACE_FLOW, "Setting FlexDC %s poll mode to %d\n", this->portName, value);
+                this->pollMode = static_cast<flexdcPollMode>(value);
+                p_axis->setIntegerParam(function, value);
+            } else {
+                log(ASYN_TRACE_ERROR, "Invalid FlexDC %s poll mode %d\n", this->portName, value);
+                status = asynError;
+            }
+
+            p_axis->callParamCallbacks();
+        } else if (function == driverCapture) {
+            p_axis->setIntegerParam(function, value);
+            p_axis->captureEnabled = (value != 0);
+            if (p_axis->captureEnabled) {
+                log(ASYN_TRACE_FLOW, "Starting FlexDC %s axis %d position capture\n", this->portName, p_axis->axisNo_);
+                p_axis->startCapture();
+                epicsEventSignal(this->captureEvent);
+            }
+
+            status = p_axis->callParamCallbacks();
+        } else if (function == driverCaptureDecimation) {
+            if (value >= 1) {
+                p_axis->setIntegerParam(function, value);
+            } else {
+                log(ASYN_TRACE_ERROR, "Invalid FlexDC %s capture decimation %d\n", this->portName, value);
+                status = asynError;
+            }
+
+            p_axis->callParamCallbacks();
+        } else if (function == driverStatsReset) {
+            log(ASYN_TRACE_FLOW, "Resetting FlexDC %s statistics\n", this->portName);
+            p_axis->setIntegerParam(function, value);
+            resetStatistics();
+
+            status = p_axis->callParamCallbacks();
+        } else if (function == driverRecorderArm) {
+            p_axis->setIntegerParam(function, value);
+            if (value) {
+                status = p_axis->armRecorder();
+            } else {
+                p_axis->callParamCallbacks();
+            }
+        } else if ((function == driverRecorderLength) || (function == driverRecorderGap)) {
+            if ((value >= 1) && ((function == driverRecorderGap) || (value <= FLEXDC_MAX_RECORD_POINTS))) {
+                p_axis->setIntegerParam(function, value);
+            } else {
+                log(ASYN_TRACE_ERROR, "Invalid FlexDC %s recorder length or gap %d\n", this->portName, value);
+                status = asynError;
+            }
+
+            p_axis->callParamCallbacks();
+        } else {
+            status = asynMotorController::writeInt32(pasynUser, value);
+        }
+    } else {
+        log(ASYN_TRACE_ERROR, "Unable to retrieve FlexDC %s axis from asynUser in %s\n", this->portName, functionName);
+        status = asynError;
+    }
+
+    return status;
+}
+
+
+/** Called when the deferred moves flag is changed.
+  * While set, axis moves are only recorded. When cleared, the recorded moves are started together.
+  *
+  * \param[in] deferMoves  true to defer moves, false to start the deferred moves
+  *
+  * \return Result of startDeferredMoves(), or asynSuccess
+  */
+asynStatus FlexDCController::setDeferredMoves(bool deferMoves) {
+    asynStatus status = asynSuccess;
+
+    log(ASYN_TRACE_FLOW, "Setting FlexDC %s deferred moves to %d\n", this->portName, deferMoves);
+    if ((!deferMoves) && (this->movesDeferred)) {
+        status = startDeferredMoves();
+    }
+    this->movesDeferred = deferMoves;
+
+    return status;
+}
+
+/** Homes all axes of all units at once, each with its configured HOMR or HOMF macro.
+  * Busy axes are halted first, and waited for together; then the macros of the axes of each unit
+  * are started by a single command, and the axes tracked by their homing stage as after home().
+  * Axes whose macro is disabled are left alone.
+  *
+  * \param[in] forwards  true to use the HOMF macros, false for the HOMR ones
+  *
+  * \return asynSuccess if all units started homing, the error of the last failing one otherwise
+  */
+asynStatus FlexDCController::homeAllAxes(bool forwards) {
+    asynStatus status, final_status = asynSuccess;
+    flexdcHomeMacro home_types[CTRL_NUM_AXES];
+    FlexDCAxis *p_axis;
+    bool busy[CTRL_NUM_AXES], homing;
+    int unit, axis, hom_type;
+
+    log(ASYN_TRACE_FLOW, "Homing all FlexDC %s axes %s\n", this->portName, forwards ? "forwards" : "in reverse");
+
+    for (unit=0; unit<this->numUnits; unit++) {
+        status = asynSuccess;
+
+        // Halt all busy axes of the unit before waiting for any, so that they stop concurrently
+        for (axis=0; axis<CTRL_NUM_AXES; axis++) {
+            p_axis = getAxis(unit*CTRL_NUM_AXES+axis);
+            busy[axis] = (p_axis) && ((p_axis->macroResult == EXECUTING) || (p_axis->motionStatus != 0));
+            if (!busy[axis]) continue;
+
+            if ((status == asynSuccess) && (p_axis->macroResult == EXECUTING)) {
+                status = p_axis->haltHomingMacro();
+            }
+            if ((status == asynSuccess) && (p_axis->motionStatus != 0)) {
+                status = p_axis->stopMotor();
+            }
+        }
+        for (axis=0; (status == asynSuccess) && (axis<CTRL_NUM_AXES); axis++) {
+            if (busy[axis]) {
+                status = getAxis(unit*CTRL_NUM_AXES+axis)->waitMotionStopped();
+            }
+        }
+
+        for (axis=0; axis<CTRL_NUM_AXES; axis++) {
+            p_axis = getAxis(unit*CTRL_NUM_AXES+axis);
+            hom_type = DISABLED;
+            if (p_axis) {
+                p_axis->getIntegerParam(forwards ? driverHomeForwardMacro : driverHomeReverseMacro, &hom_type);
+            }
+            home_types[axis] = static_cast<flexdcHomeMacro>(hom_type);
+        }
+        homing = (status == asynSuccess) && (FlexDCAxis::buildHomeAllCommand(this->outString_, home_types, CTRL_NUM_AXES, forwards));
+        if ((status == asynSuccess) && (!homing)) {
+            // Nothing to start, but the halted axes still get their status published below
+            log(ASYN_TRACE_FLOW, "No FlexDC %s unit %d axis to home\n", this->portName, unit);
+        }
+
+        for (axis=0; (homing) && (axis<CTRL_NUM_AXES); axis++) {
+            p_axis = getAxis(unit*CTRL_NUM_AXES+axis);
+            if ((!p_axis) || (home_types[axis] <= DISABLED)) continue;
+
+            p_axis->deferredMove.pending = false;
+            p_axis->moveState = MOVE_UNTRACKED;
+            p_axis->newMotionGeneration();
+            p_axis->setIntegerParam(motorStatusDone_, 0);
+            p_axis->setIntegerParam(motorStatusHome_, 1);
+            p_axis->setIntegerParam(motorStatusHomed_, 0);
+            p_axis->setHomeStage(HOME_STARTED);
+            p_axis->pollTier = TIER_HOMING;
+        }
+        if (homing) {
+            status = writeController(unit);
+        }
+
+        for (axis=0; axis<CTRL_NUM_AXES; axis++) {
+            p_axis = getAxis(unit*CTRL_NUM_AXES+axis);
+            if ((!p_axis) || (((!homing) || (home_types[axis] <= DISABLED)) && (!busy[axis]))) continue;
+
+            if ((status != asynSuccess) && (p_axis->homeStage == HOME_STARTED)) {
+                p_axis->setIntegerParam(motorStatusHome_, 0);
+                p_axis->setIntegerParam(motorStatusDone_, 1);
+                p_axis->setHomeStage(HOME_FAILED);
+                p_axis->pollTier = TIER_IDLE;
+            }
+            p_axis->setStatusProblem(status);
+            p_axis->callParamCallbacks();
+        }
+        if (status != asynSuccess) {
+            final_status = status;
+        }
+    }
+
+    wakeupPoller();
+    return final_status;
+}
+
+/** Starts all deferred moves.
+  * The setup of all moves of a unit and a single begin are sent in one command, so that its axes start together:
+  * the begin addresses all axes (CTRL_ALL_AXES) if they all have a move pending, only the moving one otherwise.
+  * Units are independent controllers, so moves on different units are only started as close together as their I/O threads allow.
+  *
+  * \return asynSuccess if all commands were queued, the error of the last failing one otherwise
+  */
+asynStatus FlexDCController::startDeferredMoves() {
+    asynStatus status, final_status = asynSuccess;
+    flexdcDeferredMove moves[CTRL_NUM_AXES];
+    FlexDCAxis *p_axis;
+    int unit, axis;
+    bool any_pending;
+
+    for (unit=0; unit<this->numUnits; unit++) {
+        any_pending = false;
+        for (axis=0; axis<CTRL_NUM_AXES; axis++) {
+            p_axis = getAxis(unit*CTRL_NUM_AXES+axis);
+            if (p_axis) {
+                moves[axis] = p_axis->deferredMove;
+            } else {
+                moves[axis].pending = false;
+            }
+            any_pending = any_pending || moves[axis].pending;
+        }
+        if (!any_pending) continue;
+
+        log(ASYN_TRACE_FLOW, "Starting FlexDC %s unit %d deferred moves\n", this->portName, unit);
+        if (FlexDCAxis::buildCoordinatedMoveCommand(this->outString_, moves, CTRL_NUM_AXES)) {
+            status = writeController(unit);
+        } else {
+            log(ASYN_TRACE_ERROR, "Unable to build FlexDC %s unit %d deferred moves command\n", this->portName, unit);
+            status = asynError;
+        }
+        if (status != asynSuccess) {
+            final_status = status;
+        }
+
+        for (axis=0; axis<CTRL_NUM_AXES; axis++) {
+            p_axis = getAxis(unit*CTRL_NUM_AXES+axis);
+            if ((!p_axis) || (!moves[axis].pending)) continue;
+
+            p_axis->deferredMove.pending = false;
+            if (status == asynSuccess) {
+                p_axis->newMotionGeneration();
+                p_axis->setIntegerParam(motorStatusDone_, 0);
+                p_axis->targetPosition = moves[axis].relative ? p_axis->positionReadback+moves[axis].position : moves[axis].position;
+                p_axis->pollTier = TIER_MOVING;
+                p_axis->moveState = MOVE_SENT;
+                epicsTimeGetCurrent(&p_axis->moveTimes[MOVE_SENT]);
+            }
+            p_axis->setStatusProblem(status);
+            p_axis->callParamCallbacks();
+        }
+    }
+
+    return final_status;
+}
+
+/** Allocates the profile arrays of the controller and of all axes.
+  *
+  * \param[in] maxPoints  Maximum number of profile points
+  *
+  * \return Result of asynMotorController::initializeProfile()
+  */
+asynStatus FlexDCController::initializeProfile(size_t maxPoints) {
+    if (this->profilePointTimes) free(this->profilePointTimes);
+    this->profilePointTimes = (double *)calloc(maxPoints, sizeof(double));
+
+    return asynMotorController::initializeProfile(maxPoints);
+}
+
+/** Builds the profile: uploads the positions and times of all used axes into the controller PT arrays.
+  * Only absolute profiles are supported, starting from wherever the axes are.
+  *
+  * \return asynSuccess if the profile was uploaded, asynError otherwise
+  */
+asynStatus FlexDCController::buildProfile() {
+    asynStatus status = asynSuccess;
+    FlexDCAxis *p_axis;
+    int axis, point, num_points = 0, move_mode = 0, use_axis, time_ms, num_used = 0, num_commands = 0;
+    double elapsed = 0.0, upload_time, upload_rate;
+    epicsTimeStamp upload_start, upload_end;
+    const char *message = "";
+
+    asynMotorController::buildProfile();
+
+    setProfileState(profileBuildState_, PROFILE_BUILD_BUSY, profileBuildStatus_, PROFILE_STATUS_UNDEFINED, profileBuildMessage_, "");
+
+    getIntegerParam(profileNumPoints_, &num_points);
+    getIntegerParam(profileMoveMode_, &move_mode);
+    if ((num_points < 1) || (num_points > (int)this->maxProfilePoints_)) {
+        message = "Invalid number of points";
+        status = asynError;
+    } else if (move_mode != 0) {
+        message = "Only absolute profiles are supported";
+        status = asynError;
+    }
+
+    // Cumulated end time of each point, checking that each fits the controller time resolution
+    for (point=0; (status == asynSuccess) && (point<num_points); point++) {
+        time_ms = (int)(this->profileTimes_[point]*1000.+0.5);
+        if (time_ms < 1) {
+            message = "Point times must be at least 1 ms";
+            status = asynError;
+        }
+        elapsed += time_ms/1000.;
+        this->profilePointTimes[point] = elapsed;
+    }
+
+    epicsTimeGetCurrent(&upload_start);
+    for (axis=0; (status == asynSuccess) && (axis<numAxes_); axis++) {
+        p_axis = getAxis(axis);
+        use_axis = 0;
+        getIntegerParam(axis, profileUseAxis_, &use_axis);
+        if ((!p_axis) || (!use_axis)) continue;
+        num_used++;
+
+        log(ASYN_TRACE_FLOW, "Uploading %d profile points to FlexDC %s axis %d\n", num_points, this->portName, axis);
+        status = uploadArray(p_axis->unit, p_axis->unitAxis, AXIS_PROFILE_POS_ARRAY, p_axis->profilePositions_, num_points, 1.0, &num_commands);
+        if (status == asynSuccess) {
+            status = uploadArray(p_axis->unit, p_axis->unitAxis, AXIS_PROFILE_TIME_ARRAY, this->profileTimes_, num_points, 1000.0, &num_commands);
+        }
+        if (status != asynSuccess) {
+            message = "Upload to controller failed";
+        }
+    }
+    if ((status == asynSuccess) && (!num_used)) {
+        message = "No axis used";
+        status = asynError;
+    }
+
+    if ((status == asynSuccess) && (num_used)) {
+        epicsTimeGetCurrent(&upload_end);
+        upload_time = epicsTimeDiffInSeconds(&upload_end, &upload_start);
+        upload_rate = (upload_time > 0.0) ? num_used*num_points/upload_time : 0.0;
+        log(ASYN_TRACE_FLOW, "Uploaded %d points to FlexDC %s in %d commands, %.0f points/s\n", num_used*num_points, this->portName, num_commands, upload_rate);
+        for (axis=0; axis<numAxes_; axis++) {
+            setDoubleParam(axis, driverUploadRate, upload_rate);
+            callParamCallbacks(axis);
+        }
+    }
+
+    if (status == asynSuccess) {
+        setProfileState(profileBuildState_, PROFILE_BUILD_DONE, profileBuildStatus_, PROFILE_STATUS_SUCCESS, profileBuildMessage_, "");
+    } else {
+        log(ASYN_TRACE_ERROR, "Unable to build FlexDC %s profile: %s\n", this->portName, message);
+        setProfileState(profileBuildState_, PROFILE_BUILD_DONE, profileBuildStatus_, PROFILE_STATUS_FAILURE, profileBuildMessage_, message);
+    }
+
+    return status;
+}
+
+/** Writes values into a controller array, starting at index 1, packing as many elements per command line as fit.
+  * Double-buffered: the next chunk is encoded while the previous one is being sent, with two chunks at most in flight.
+  * Must be called with the controller lock held, which is released while waiting for the controller.
+  *
+  * \param[in]  unit          Index of the FlexDC unit
+  * \param[in]  unit_axis     Index of the axis within the unit
+  * \param[in]  array         Name of the controller array
+  * \param[in]  values        Values to write, multiplied by scale and rounded to the nearest integer
+  * \param[in]  count         Number of values
+  * \param[in]  scale         Scale factor applied to values
+  * \param[out] num_commands  Incremented by the number of command lines sent (can be NULL)
+  *
+  * \return asynSuccess if all chunks were acknowledged, the first error otherwise
+  */
+asynStatus FlexDCController::uploadArray(int unit, int unit_axis, const char *array, const double *values, int count, double scale, int *num_commands) {
+    asynStatus status = asynSuccess, chunk_status;
+    FlexDCCommandQueue *p_queue;
+    FlexDCRequest *in_flight[2] = { NULL, NULL };
+    char chunk[MAX_CONTROLLER_STRING_SIZE];
+    int sent = 0, packed, slot = 0;
+
+    if ((unit < 0) || (unit >= this->numUnits)) {
+        return asynError;
+    }
+    p_queue = this->units[unit].commandQueue;
+
+    while ((sent < count) || (in_flight[0]) || (in_flight[1])) {
+        packed = 0;
+        if ((sent < count) && (status == asynSuccess)) {
+            packed = FlexDCAxis::buildArrayChunkCommand(chunk, CTRL_MAX_LINE_LENGTH, unit_axis, array, sent+1, values+sent, count-sent, scale);
+            if (!packed) {
+                status = asynError;
+            }
+        }
+
+        // Reuse the older of the two buffers in flight
+        if (in_flight[slot]) {
+            unlock();
+            p_queue->wait(in_flight[slot]);
+            lock();
+            chunk_status = p_queue->release(in_flight[slot], NULL, 0);
+            in_flight[slot] = NULL;
+            if ((chunk_status != asynSuccess) && (status == asynSuccess)) {
+                status = chunk_status;
+            }
+        }
+
+        if ((packed) && (status == asynSuccess)) {
+            in_flight[slot] = p_queue->post(chunk, true, DEFAULT_CONTROLLER_TIMEOUT);
+            if (in_flight[slot]) {
+                sent += packed;
+                if (num_commands) (*num_commands)++;
+            } else {
+                status = asynError;
+            }
+        } else if (status != asynSuccess) {
+            sent = count;
+        }
+        slot ^= 1;
+    }
+
+    return status;
+}
+
+/** Reads a controller array, in chunks of as many element queries as fit in a command line (and their values in a reply line),
+  * keeping two chunks in flight so that the controller always has the next one queued.
+  * Must be called with the controller lock held: the lock is released while waiting for the I/O thread.
+  *
+  * \param[in]  unit       Index of the FlexDC unit
+  * \param[in]  unit_axis  Axis of the unit
+  * \param[in]  array      Name of the 1-based controller array
+  * \param[out] values     Where to store the elements
+  * \param[in]  count      Number of elements to read, from index 1
+  *
+  * \return asynSuccess if all elements were read, the error of the first failing chunk otherwise
+  */
+asynStatus FlexDCController::downloadArray(int unit, int unit_axis, const char *array, double *values, int count) {
+    asynStatus status = asynSuccess, chunk_status;
+    FlexDCCommandQueue *p_queue;
+    FlexDCRequest *in_flight[2] = { NULL, NULL };
+    int first[2] = { 0, 0 }, expected[2] = { 0, 0 };
+    char chunk[MAX_CONTROLLER_STRING_SIZE];
+    char reply[MAX_CONTROLLER_STRING_SIZE];
+    char *fields[CTRL_MAX_REPLY_VALUES];
+    long value;
+    int requested = 0, packed, slot = 0, field, num_fields;
+
+    if ((unit < 0) || (unit >= this->numUnits)) {
+        return asynError;
+    }
+    p_queue = this->units[unit].commandQueue;
+
+    while ((requested < count) || (in_flight[0]) || (in_flight[1])) {
+        packed = 0;
+        if ((requested < count) && (status == asynSuccess)) {
+            packed = FlexDCAxis::buildArrayQueryCommand(chunk, CTRL_MAX_LINE_LENGTH, unit_axis, array, requested+1,
+                                                        (count-requested < CTRL_MAX_REPLY_VALUES) ? count-requested : CTRL_MAX_REPLY_VALUES);
+            if (!packed) {
+                status = asynError;
+            }
+        }
+
+        // Collect the older of the two chunks in flight
+        if (in_flight[slot]) {
+            unlock();
+            p_queue->wait(in_flight[slot]);
+            lock();
+            chunk_status = p_queue->release(in_flight[slot], reply, sizeof(reply));
+            in_flight[slot] = NULL;
+            if (chunk_status == asynSuccess) {
+                num_fields = FlexDCAxis::splitReply(reply, fields, expected[slot]);
+                for (field=0; (field < num_fields) && (FlexDCAxis::parseInteger(fields[field], value)); field++) {
+                    values[first[slot]+field] = (double)value;
+                }
+                if (field != expected[slot]) {
+                    log(ASYN_TRACE_ERROR, "FlexDC %s unit %d replied %d out of %d %s values\n", this->portName, unit, field, expected[slot], array);
+                    chunk_status = asynError;
+                }
+            }
+            if ((chunk_status != asynSuccess) && (status == asynSuccess)) {
+                status = chunk_status;
+            }
+        }
+
+        if ((packed) && (status == asynSuccess)) {
+            in_flight[slot] = p_queue->post(chunk, true, DEFAULT_CONTROLLER_TIMEOUT);
+            if (in_flight[slot]) {
+                first[slot] = requested;
+                expected[slot] = packed;
+                requested += packed;
+            } else {
+                status = asynError;
+            }
+        } else if (status != asynSuccess) {
+            requested = count;
+        }
+        slot ^= 1;
+    }
+
+    return status;
+}
+
+/** Executes the built profile: all used axes of each unit are switched to PT mode and started by a single begin.
+  * Their on-board recorders are armed beforehand, to record the trajectory actually followed from that begin on.
+  * The trajectory then runs on the controller; poll() only follows its progress.
+  *
+  * \return asynSuccess if the profile was started, asynError otherwise
+  */
+asynStatus FlexDCController::executeProfile() {
+    asynStatus status = asynSuccess;
+    FlexDCAxis *p_axis;
+    bool used[CTRL_NUM_AXES];
+    int unit, axis, num_points = 0, build_status = PROFILE_STATUS_UNDEFINED, use_axis;
+
+    getIntegerParam(profileBuildStatus_, &build_status);
+    getIntegerParam(profileNumPoints_, &num_points);
+    if ((build_status != PROFILE_STATUS_SUCCESS) || (this->profileExecuting)) {
+        setProfileState(profileExecuteState_, PROFILE_EXECUTE_DONE, profileExecuteStatus_, PROFILE_STATUS_FAILURE, profileExecuteMessage_,
+                        this->profileExecuting ? "Profile already executing" : "Profile not built");
+        return asynError;
+    }
+
+    setProfileState(profileExecuteState_, PROFILE_EXECUTE_EXECUTING, profileExecuteStatus_, PROFILE_STATUS_UNDEFINED, profileExecuteMessage_, "");
+    epicsTimeGetCurrent(&this->profileStartTime);
+    this->profileCapturedPoints = 0;
+
+    for (unit=0; (status == asynSuccess) && (unit<this->numUnits); unit++) {
+        for (axis=0; axis<CTRL_NUM_AXES; axis++) {
+            use_axis = 0;
+            getIntegerParam(unit*CTRL_NUM_AXES+axis, profileUseAxis_, &use_axis);
+            used[axis] = use_axis;
+        }
+        for (axis=0; (status == asynSuccess) && (axis<CTRL_NUM_AXES); axis++) {
+            p_axis = getAxis(unit*CTRL_NUM_AXES+axis);
+            if ((p_axis) && (used[axis])) {
+                status = p_axis->armProfileRecorder(this->profilePointTimes[num_points-1]);
+            }
+        }
+        if ((status != asynSuccess) || (!FlexDCAxis::buildProfileStartCommand(this->outString_, used, CTRL_NUM_AXES, num_points))) continue;
+
+        log(ASYN_TRACE_FLOW, "Starting FlexDC %s unit %d profile\n", this->portName, unit);
+        status = writeController(unit);
+
+        for (axis=0; (status == asynSuccess) && (axis<CTRL_NUM_AXES); axis++) {
+            p_axis = getAxis(unit*CTRL_NUM_AXES+axis);
+            if ((!p_axis) || (!used[axis])) continue;
+            p_axis->newMotionGeneration();
+            p_axis->setIntegerParam(motorStatusDone_, 0);
+            p_axis->targetPosition = (long)p_axis->profilePositions_[num_points-1];
+            p_axis->pollTier = TIER_MOVING;
+            p_axis->callParamCallbacks();
+        }
+    }
+
+    if (status == asynSuccess) {
+        this->profileExecuting = true;
+        wakeupPoller();
+    } else {
+        setProfileState(profileExecuteState_, PROFILE_EXECUTE_DONE, profileExecuteStatus_, PROFILE_STATUS_FAILURE, profileExecuteMessage_, "Start failed");
+    }
+
+    return status;
+}
+
+/** Aborts an executing profile, by stopping all used axes.
+  *
+  * \return asynSuccess
+  */
+asynStatus FlexDCController::abortProfile() {
+    FlexDCAxis *p_axis;
+    epicsTimeStamp abort_time;
+    int axis, use_axis;
+
+    epicsTimeGetCurrent(&abort_time);
+    for (axis=0; axis<numAxes_; axis++) {
+        p_axis = getAxis(axis);
+        use_axis = 0;
+        getIntegerParam(axis, profileUseAxis_, &use_axis);
+        if ((p_axis) && (use_axis)) {
+            p_axis->stopMotor(&abort_time);
+        }
+    }
+
+    if (this->profileExecuting) {
+        this->profileExecuting = false;
+        setProfileState(profileExecuteState_, PROFILE_EXECUTE_DONE, profileExecuteStatus_, PROFILE_STATUS_ABORT, profileExecuteMessage_, "Aborted");
+    }
+
+    return asynSuccess;
+}
+
+/** Publishes the positions and following errors recorded by the controller during the last profile execution.
+  * Recorders that finished but were not read back yet by the recorder thread are read back first.
+  *
+  * \return asynSuccess, or asynError if the recorder of a used axis has not recorded the profile
+  */
+asynStatus FlexDCController::readbackProfile() {
+    asynStatus status = asynSuccess;
+    FlexDCAxis *p_axis;
+    int axis, point, use_axis, num_points = 0;
+
+    setProfileState(profileReadbackState_, PROFILE_READBACK_BUSY, profileReadbackStatus_, PROFILE_STATUS_UNDEFINED, profileReadbackMessage_, "");
+    getIntegerParam(profileNumPoints_, &num_points);
+
+    for (axis=0; (status == asynSuccess) && (axis<numAxes_); axis++) {
+        p_axis = getAxis(axis);
+        use_axis = 0;
+        getIntegerParam(axis, profileUseAxis_, &use_axis);
+        if ((!p_axis) || (!use_axis) || (!p_axis->profileCapturePositions)) continue;
+
+        if (p_axis->profileRecording) {
+            p_axis->updateRecorder();
+        }
+        if (p_axis->profileRecordedPoints != num_points) {
+            status = asynError;
+            continue;
+        }
+
+        for (point=0; point<num_points; point++) {
+            p_axis->profileReadbacks_[point] = p_axis->profileCapturePositions[point];
+            p_axis->profileFollowingErrors_[point] = p_axis->profileCaptureErrors[point];
+        }
+        // Converts to user units and publishes
+        p_axis->readbackProfile();
+    }
+
+    if (status == asynSuccess) {
+        setIntegerParam(profileNumReadbacks_, num_points);
+        setProfileState(profileReadbackState_, PROFILE_READBACK_DONE, profileReadbackStatus_, PROFILE_STATUS_SUCCESS, profileReadbackMessage_, "");
+    } else {
+        log(ASYN_TRACE_ERROR, "FlexDC %s profile was not recorded\n", this->portName);
+        setIntegerParam(profileNumReadbacks_, 0);
+        setProfileState(profileReadbackState_, PROFILE_READBACK_DONE, profileReadbackStatus_, PROFILE_STATUS_FAILURE, profileReadbackMessage_, "Profile not recorded");
+    }
+
+    return status;
+}
+
+/** Follows an executing profile, from poll(): the current point is the last one whose time has elapsed.
+  * The profile is done once all points have elapsed and all used axes have stopped.
+  */
+void FlexDCController::updateProfileExecution() {
+    FlexDCAxis *p_axis;
+    epicsTimeStamp now;
+    double elapsed;
+    int axis, num_points = 0, use_axis;
+    bool all_stopped = true;
+
+    getIntegerParam(profileNumPoints_, &num_points);
+    epicsTimeGetCurrent(&now);
+    elapsed = epicsTimeDiffInSeconds(&now, &this->profileStartTime);
+
+    for (axis=0; axis<numAxes_; axis++) {
+        p_axis = getAxis(axis);
+        use_axis = 0;
+        getIntegerParam(axis, profileUseAxis_, &use_axis);
+        if ((!p_axis) || (!use_axis)) continue;
+        all_stopped = all_stopped && (p_axis->motionStatus == 0);
+    }
+
+    while ((this->profileCapturedPoints < num_points) && (this->profilePointTimes[this->profileCapturedPoints] <= elapsed)) {
+        this->profileCapturedPoints++;
+    }
+    setIntegerParam(profileCurrentPoint_, this->profileCapturedPoints);
+
+    if ((this->profileCapturedPoints >= num_points) && (all_stopped)) {
+        this->profileExecuting = false;
+        setProfileState(profileExecuteState_, PROFILE_EXECUTE_DONE, profileExecuteStatus_, PROFILE_STATUS_SUCCESS, profileExecuteMessage_, "");
+    } else if ((num_points > 0) && (elapsed > this->profilePointTimes[num_points-1]+PROFILE_END_TIMEOUT)) {
+        log(ASYN_TRACE_ERROR, "FlexDC %s profile did not complete in time\n", this->portName);
+        abortProfile();
+        setProfileState(profileExecuteState_, PROFILE_EXECUTE_DONE, profileExecuteStatus_, PROFILE_STATUS_TIMEOUT, profileExecuteMessage_, "Timeout");
+    } else {
+        callParamCallbacks();
+    }
+}
+
+/** Sets the state, status and message of a profile action, and publishes them.
+  *
+  */
+void FlexDCController::setProfileState(int state_param, int state, int status_param, int status, int message_param, const char *message) {
+    setIntegerParam(state_param, state);
+    setIntegerParam(status_param, status);
+    setStringParam(message_param, message);
+    callParamCallbacks();
+}
+
+/** Body of the position capture thread.
+  * Every capture period (the shortest of the capturing axes), it samples the readback and position error of all capturing axes,
+  * then sleeps until the next period, or until capture is started on an axis.
+  * Like the poller, it exits once the controller is shutting down.
+  *
+  */
+void FlexDCController::captureThread() {
+    bool capture[FLEXDC_MAX_UNITS*CTRL_NUM_AXES];
+    FlexDCAxis *p_axis;
+    double period, axis_period;
+    bool any_capture;
+    int axis;
+
+    while (true) {
+        lock();
+        if (this->shuttingDown_) {
+            unlock();
+            break;
+        }
+        any_capture = false;
+        period = 0.0;
+        for (axis=0; axis<this->numAxes_; axis++) {
+            p_axis = getAxis(axis);
+            capture[axis] = (p_axis) && (p_axis->captureEnabled);
+            if (!capture[axis]) continue;
+
+            // All capturing axes are sampled together, at the shortest of their periods
+            getDoubleParam(axis, driverCapturePeriod, &axis_period);
+            if ((!any_capture) || (axis_period < period)) period = axis_period;
+            any_capture = true;
+        }
+        unlock();
+
+        if (!any_capture) {
+            epicsEventWaitWithTimeout(this->captureEvent, CAPTURE_IDLE_WAIT);
+            continue;
+        }
+
+        sampleUnits(capture);
+
+        if (period < MIN_CAPTURE_PERIOD) period = MIN_CAPTURE_PERIOD;
+        epicsEventWaitWithTimeout(this->captureEvent, period/1000.);
+    }
+}
+
+/** Samples the capturing axes of all units, and pushes the samples into their capture rings.
+  * Units are queried in parallel, and each sample is timestamped halfway through the exchange with its unit.
+  * Called without the controller lock held: only the capture rings are shared with the poller.
+  *
+  * \param[in] capture  Which driver axes to sample
+  */
+void FlexDCController::sampleUnits(const bool *capture) {
+    FlexDCRequest *requests[FLEXDC_MAX_UNITS];
+    char command[MAX_CONTROLLER_STRING_SIZE];
+    char reply[MAX_CONTROLLER_STRING_SIZE];
+    char *fields[2*CTRL_NUM_AXES];
+    epicsTimeStamp sent, received;
+    FlexDCSample sample;
+    FlexDCAxis *p_axis;
+    int unit, axis, field, num_fields;
+
+    epicsTimeGetCurrent(&sent);
+    for (unit=0; unit<this->numUnits; unit++) {
+        requests[unit] = NULL;
+        if (FlexDCAxis::buildCaptureCommand(command, capture+unit*CTRL_NUM_AXES, CTRL_NUM_AXES)) {
+            requests[unit] = this->units[unit].commandQueue->post(command, true, DEFAULT_CONTROLLER_TIMEOUT);
+        }
+    }
+
+    for (unit=0; unit<this->numUnits; unit++) {
+        if (!requests[unit]) continue;
+
+        this->units[unit].commandQueue->wait(requests[unit]);
+        epicsTimeGetCurrent(&received);
+        if (this->units[unit].commandQueue->release(requests[unit], reply, sizeof(reply)) != asynSuccess) {
+            continue;
+        }
+
+        sample.time = sent;
+        epicsTimeAddSeconds(&sample.time, epicsTimeDiffInSeconds(&received, &sent)/2.);
+
+        // Replies are ordered by axis, readback then position error, skipping the axes not captured
+        num_fields = FlexDCAxis::splitReply(reply, fields, 2*CTRL_NUM_AXES);
+        field = 0;
+        for (axis=0; axis<CTRL_NUM_AXES; axis++) {
+            if (!capture[unit*CTRL_NUM_AXES+axis]) continue;
+            p_axis = getAxis(unit*CTRL_NUM_AXES+axis);
+
+            if ((field+1 < num_fields) && (FlexDCAxis::parseInteger(fields[field], sample.position)) && (FlexDCAxis::parseInteger(fields[field+1], sample.error))) {
+                p_axis->captureRing->push(sample);
+            }
+            field += 2;
+        }
+    }
+}
+
+/** Body of the connection supervision thread.
+  * Checks every LINK_CHECK_PERIOD, or as soon as signalled by the poller, whether each unit is still reachable.
+  * A unit found down gets its axes flagged and left alone by the poller, while it is reconnected with an exponential backoff.
+  * It also writes the snapshots queued by the poller, so that file I/O never holds the controller lock.
+  *
+  */
+void FlexDCController::linkThread() {
+    double retry_delay[FLEXDC_MAX_UNITS];
+    epicsTimeStamp now, next_retry[FLEXDC_MAX_UNITS];
+    bool link_down;
+    int unit;
+
+    for (unit=0; unit<this->numUnits; unit++) {
+        retry_delay[unit] = LINK_RETRY_MIN;
+        epicsTimeGetCurrent(&next_retry[unit]);
+    }
+
+    while (true) {
+        epicsEventWaitWithTimeout(this->linkEvent, LINK_CHECK_PERIOD);
+
+        lock();
+        if (this->shuttingDown_) {
+            unlock();
+            break;
+        }
+        unlock();
+
+        writeSnapshot();
+
+        for (unit=0; unit<this->numUnits; unit++) {
+            if (!this->units[unit].pasynUserCommon) continue;
+
+            lock();
+            link_down = this->units[unit].linkDown;
+            unlock();
+
+            epicsTimeGetCurrent(&now);
+            if (!link_down) {
+                if (checkLink(unit)) continue;
+
+                log(ASYN_TRACE_ERROR, "FlexDC %s unit %d connection lost\n", this->portName, unit);
+                setLinkState(unit, false);
+                retry_delay[unit] = LINK_RETRY_MIN;
+                next_retry[unit] = now;
+            }
+
+            if (epicsTimeDiffInSeconds(&now, &next_retry[unit]) < 0.0) continue;
+
+            if (reconnectUnit(unit) == asynSuccess) {
+                log(ASYN_TRACE_ERROR, "FlexDC %s unit %d reconnected\n", this->portName, unit);
+                setLinkState(unit, true);
+                wakeupPoller();
+            } else {
+                epicsTimeGetCurrent(&next_retry[unit]);
+                epicsTimeAddSeconds(&next_retry[unit], retry_delay[unit]);
+                retry_delay[unit] *= 2.;
+                if (retry_delay[unit] > LINK_RETRY_MAX) retry_delay[unit] = LINK_RETRY_MAX;
+            }
+        }
+    }
+}
+
+/** Body of the recorder thread.
+  * Every idle poll period, it checks the armed recorders of all connected axes,
+  * and reads back those that have finished, so that the poller never waits for a readout.
+  * Like the poller, it exits once the controller is shutting down.
+  *
+  */
+void FlexDCController::recorderThread() {
+    FlexDCAxis *p_axis;
+    double period;
+    int axis;
+
+    while (true) {
+        lock();
+        period = this->idlePollPeriod_;
+        unlock();
+        epicsThreadSleep(period);
+
+        lock();
+        if (this->shuttingDown_) {
+            unlock();
+            break;
+        }
+        for (axis=0; axis<this->numAxes_; axis++) {
+            p_axis = getAxis(axis);
+            if ((p_axis) && (!this->units[p_axis->unit].linkDown)) {
+                p_axis->updateRecorder();
+            }
+        }
+        unlock();
+    }
+}
+
+/** Tells whether a unit is still reachable: connected, and not failing every exchange.
+  *
+  * \param[in] unit  The unit
+  *
+  * \return false if the unit must be reconnected
+  */
+bool FlexDCController::checkLink(int unit) {
+    int connected = 1;
+
+    pasynManager->isConnected(this->units[unit].pasynUser, &connected);
+    return (connected) && (this->units[unit].commandQueue->getConsecutiveFailures() < LINK_FAILURE_THRESHOLD);
+}
+
+/** Attempts to bring a unit back: connects it if needed, sets up its EOS again, and checks that it answers.
+  * Called without the lock held.
+  *
+  * \param[in] unit  The unit
+  *
+  * \return asynSuccess if the unit answered
+  */
+asynStatus FlexDCController::reconnectUnit(int unit) {
+    FlexDCUnit *p_unit = &this->units[unit];
+    FlexDCRequest *request;
+    char reply[MAX_CONTROLLER_STRING_SIZE];
+    asynStatus status;
+    int connected = 0;
+
+    pasynManager->isConnected(p_unit->pasynUser, &connected);
+    if (!connected) {
+        status = pasynCommonSyncIO->connectDevice(p_unit->pasynUserCommon);
+        if (status != asynSuccess) {
+            return status;
+        }
+    }
+    setupEos(p_unit->pasynUser);
+
+    request = p_unit->commandQueue->post(CTRL_VER_CMD, true, DEFAULT_CONTROLLER_TIMEOUT);
+    if (!request) {
+        return asynError;
+    }
+    p_unit->commandQueue->wait(request);
+    status = p_unit->commandQueue->release(request, reply, sizeof(reply));
+
+    if (status != asynSuccess) {
+        // Connected but not answering (e.g. half-open socket): start over from a new connection next time
+        pasynCommonSyncIO->disconnectDevice(p_unit->pasynUserCommon);
+    }
+
+    return status;
+}
+
+/** Publishes the connection state of a unit to all its axes.
+  * Once back up, the unit is fully re-read in one batch by the next controller poll.
+  * Called without the lock held.
+  *
+  * \param[in] unit  The unit
+  * \param[in] up    true if reconnected, false if lost
+  */
+void FlexDCController::setLinkState(int unit, bool up) {
+    FlexDCUnit *p_unit = &this->units[unit];
+    FlexDCAxis *p_axis;
+    int axis;
+
+    lock();
+    p_unit->linkDown = !up;
+    if (up) {
+        // The unit may have been power-cycled meanwhile
+        p_unit->replyCache.clear();
+        p_unit->resyncPending = true;
+        p_unit->reconnects++;
+    }
+
+    for (axis=unit*CTRL_NUM_AXES; axis<(unit+1)*CTRL_NUM_AXES; axis++) {
+        setIntegerParam(axis, driverLinkUp, up);
+        setIntegerParam(axis, driverReconnects, (epicsInt32)p_unit->reconnects);
+        setIntegerParam(axis, motorStatusCommsError_, !up);
+        p_axis = getAxis(axis);
+        if (p_axis) {
+            if (!up) p_axis->setStatusProblem(asynDisconnected);
+            if (!up) p_axis->moveState = MOVE_UNTRACKED;
+            p_axis->programmedWindow = -1;
+            p_axis->paramsDirty = true;
+        }
+        callParamCallbacks(axis);
+    }
+    unlock();
+}
+
+/** Polls the controller, once per poller cycle and before the axes are polled.
+  * In controller batch mode, the status of all axes is queried in a single exchange
+  * and handed over to each FlexDCAxis, whose poll() then only publishes it.
+  *
+  * The moving poll period is shortened to the settle poll period while any axis is near its target,
+  * and to the home poll period while any axis is homing, and the latency of priority commands is published for all axes.
+  *
+  * \return Result of the controller exchange, or asynSuccess if not in controller batch mode
+  */
+asynStatus FlexDCController::poll() {
+    asynStatus status, final_status = asynSuccess;
+    FlexDCAxis *p_axis;
+    FlexDCUnit *p_unit;
+    unsigned int *masks;
+    char **fields;
+    int axis, unit, field, num_fields, num_expected, reply_field, num_posted = 0;
+    double last_latency, max_latency, settle_period, home_period, moving_period;
+    bool latency_changed;
+
+    epicsTimeGetCurrent(&this->pollCycleStart);
+    this->pollCycleMoving = false;
+    if (epicsTimeDiffInSeconds(&this->pollCycleStart, &this->lastStatsPublishTime) >= PUBLISH_REFRESH) {
+        publishStatistics();
+    }
+
+    moving_period = this->baseMovingPollPeriod;
+    for (unit=0; unit<this->numUnits; unit++) {
+        p_unit = &this->units[unit];
+        p_unit->commandQueue->getPriorityLatency(&last_latency, &max_latency);
+
+        latency_changed = (last_latency != p_unit->publishedStopLatency) || (max_latency != p_unit->publishedStopLatencyMax);
+        p_unit->publishedStopLatency = last_latency;
+        p_unit->publishedStopLatencyMax = max_latency;
+
+        for (axis=unit*CTRL_NUM_AXES; axis<(unit+1)*CTRL_NUM_AXES; axis++) {
+            p_axis = getAxis(axis);
+            if (latency_changed) {
+                setDoubleParam(axis, driverStopLatency, last_latency*1000.);
+                setDoubleParam(axis, driverStopLatencyMax, max_latency*1000.);
+                if (p_axis) p_axis->paramsDirty = true;
+            }
+
+            if ((p_axis) && (p_axis->pollTier == TIER_SETTLING)) {
+                p_axis->getDoubleParam(driverSettlePollPeriod, &settle_period);
+                if ((settle_period > 0.0) && (settle_period/1000. < moving_period)) {
+                    moving_period = settle_period/1000.;
+                }
+            } else if ((p_axis) && (p_axis->pollTier == TIER_HOMING)) {
+                p_axis->getDoubleParam(driverHomePollPeriod, &home_period);
+                if ((home_period > 0.0) && (home_period/1000. < moving_period)) {
+                    moving_period = home_period/1000.;
+                }
+            }
+        }
+    }
+    this->movingPollPeriod_ = moving_period;
+
+    if (this->profileExecuting) {
+        updateProfileExecution();
+    }
+
+    // Fan out: queue one exchange per unit, so that all units are queried in parallel by their I/O threads.
+    // Units just reconnected are fully re-read that way in any poll mode
+    for (unit=0; unit<this->numUnits; unit++) {
+        p_unit = &this->units[unit];
+        masks = this->pollMasks + unit*CTRL_NUM_AXES;
+        p_unit->pollRequest = NULL;
+
+        if ((p_unit->linkDown) || ((this->pollMode != POLL_CONTROLLER_BATCH) && (!p_unit->resyncPending))) {
+            continue;
+        }
+
+        for (axis=0; axis<CTRL_NUM_AXES; axis++) {
+            p_axis = getAxis(unit*CTRL_NUM_AXES+axis);
+            if ((p_axis) && (p_unit->resyncPending)) {
+                p_axis->publishedMask = 0;
+                masks[axis] = POLL_ALL_FIELDS;
+            } else {
+                masks[axis] = p_axis ? p_axis->selectPollFields() : 0;
+            }
+            if (p_axis) {
+                p_axis->pollGeneration = p_axis->motionGeneration;
+            }
+        }
+        if (FlexDCAxis::buildControllerPollCommand(this->outString_, CTRL_NUM_AXES, masks)) {
+            p_unit->pollRequest = p_unit->commandQueue->post(this->outString_, true, DEFAULT_CONTROLLER_TIMEOUT);
+            if (!p_unit->pollRequest) {
+                // Queue full: these axes poll themselves in this cycle
+                memset(masks, 0, CTRL_NUM_AXES*sizeof(*masks));
+            } else {
+                num_posted++;
+            }
+        }
+    }
+    if (!num_posted) {
+        return asynSuccess;
+    }
+
+    unlock();
+    for (unit=0; unit<this->numUnits; unit++) {
+        if (this->units[unit].pollRequest) {
+            this->units[unit].commandQueue->wait(this->units[unit].pollRequest);
+        }
+    }
+    lock();
+
+    for (unit=0; unit<this->numUnits; unit++) {
+        p_unit = &this->units[unit];
+        if (!p_unit->pollRequest) continue;
+
+        masks = this->pollMasks + unit*CTRL_NUM_AXES;
+        fields = this->pollFields + unit*CTRL_NUM_AXES*NUM_POLL_FIELDS;
+
+        num_expected = 0;
+        for (axis=0; axis<CTRL_NUM_AXES; axis++) {
+            for (field=0; field<NUM_POLL_FIELDS; field++) {
+                if (masks[axis] & POLL_FIELD(field)) num_expected++;
+            }
+        }
+
+        status = p_unit->commandQueue->release(p_unit->pollRequest, p_unit->pollReply, sizeof(p_unit->pollReply));
+        p_unit->pollRequest = NULL;
+        num_fields = 0;
+        if (status == asynSuccess) {
+            num_fields = FlexDCAxis::splitReply(p_unit->pollReply, fields, num_expected);
+            if (num_fields != num_expected) {
+                log(ASYN_TRACE_ERROR, "FlexDC %s unit %d replied %d out of %d poll fields\n", this->portName, unit, num_fields, num_expected);
+            }
+            if (p_unit->resyncPending) {
+                log(ASYN_TRACE_FLOW, "FlexDC %s unit %d state re-read after reconnection\n", this->portName, unit);
+                p_unit->resyncPending = false;
+            }
+        } else {
+            final_status = status;
+            epicsEventSignal(this->linkEvent);
+        }
+
+        // Replies are ordered by field, then by axis, skipping the fields not queried
+        reply_field = 0;
+        for (field=0; field<NUM_POLL_FIELDS; field++) {
+            for (axis=0; axis<CTRL_NUM_AXES; axis++) {
+                if (!(masks[axis] & POLL_FIELD(field))) continue;
+                p_axis = getAxis(unit*CTRL_NUM_AXES+axis);
+
+                if (reply_field < num_fields) {
+                    p_axis->polledStatus[field] = status;
+                    p_axis->polledFields[field] = fields[reply_field];
+                } else {
+                    p_axis->polledStatus[field] = (status == asynSuccess) ? asynError : status;
+                    p_axis->polledFields[field] = p_unit->pollReply+strlen(p_unit->pollReply);
+                }
+                reply_field++;
+            }
+        }
+
+        for (axis=0; axis<CTRL_NUM_AXES; axis++) {
+            p_axis = getAxis(unit*CTRL_NUM_AXES+axis);
+            if ((p_axis) && (masks[axis])) {
+                p_axis->polledMask = masks[axis];
+                p_axis->polledValid = true;
+            }
+        }
+    }
+
+    return final_status;
+}
+
+/** Accounts for the duration of the poll cycle that just ended, from the controller poll to the end of the last axis poll.
+  * The cycle overruns when it lasts longer than the poll period that follows it.
+  *
+  */
+void FlexDCController::endPollCycle() {
+    epicsTimeStamp now;
+    double duration;
+
+    epicsTimeGetCurrent(&now);
+    duration = epicsTimeDiffInSeconds(&now, &this->pollCycleStart);
+
+    this->pollCycleStats.add(duration);
+    this->lastPollCycle = duration;
+    if (duration > (this->pollCycleMoving ? this->movingPollPeriod_ : this->idlePollPeriod_)) {
+        this->pollOverruns++;
+    }
+
+    if ((this->snapshotPath[0]) && (epicsTimeDiffInSeconds(&now, &this->lastSnapshotTime) >= SNAPSHOT_PERIOD)) {
+        this->lastSnapshotTime = now;
+        saveSnapshot();
+    }
+}
+
+/** Restores the homed flag, readback position and motion end reason of all axes from the snapshot file,
+  * but only for the axes whose unit provably kept its state since then (see checkSnapshot()), checked in one batched query per unit.
+  * Axes that moved or whose unit was reset meanwhile (e.g. controller power cycle) start unhomed as usual.
+  * Then writes a new token to all units, saved with the snapshots of this IOC run.
+  * Called from the constructor, before the poller starts.
+  *
+  */
+void FlexDCController::restoreSnapshot() {
+    FlexDCAxisSnapshot saved[FLEXDC_MAX_UNITS*CTRL_NUM_AXES];
+    char command[MAX_CONTROLLER_STRING_SIZE], reply[MAX_CONTROLLER_STRING_SIZE];
+    long positions[CTRL_NUM_AXES];
+    bool restore[CTRL_NUM_AXES];
+    epicsTimeStamp now;
+    FlexDCRequest *request;
+    FlexDCAxis *p_axis;
+    epicsInt32 token = 0;
+    int num_saved, unit, unit_axis, axis;
+
+    num_saved = FlexDCSnapshot::read(this->snapshotPath, saved, this->numAxes_, &token);
+    if (num_saved < 0) {
+        log(ASYN_TRACE_FLOW, "No usable FlexDC %s snapshot in %s\n", this->portName, this->snapshotPath);
+    }
+
+    FlexDCAxis::buildSnapshotCheckCommand(command, CTRL_NUM_AXES);
+    for (unit=0; (num_saved > 0) && (unit<this->numUnits); unit++) {
+        reply[0] = '\0';
+        request = this->units[unit].commandQueue->post(command, true, DEFAULT_CONTROLLER_TIMEOUT);
+        if (request) {
+            this->units[unit].commandQueue->wait(request);
+            if (this->units[unit].commandQueue->release(request, reply, sizeof(reply)) != asynSuccess) {
+                reply[0] = '\0';
+            }
+        }
+        checkSnapshot(reply, saved+unit*CTRL_NUM_AXES, CTRL_NUM_AXES, token, positions, restore);
+
+        for (unit_axis=0; unit_axis<CTRL_NUM_AXES; unit_axis++) {
+            axis = unit*CTRL_NUM_AXES+unit_axis;
+            p_axis = getAxis(axis);
+            if ((!p_axis) || (axis >= num_saved)) continue;
+
+            if (!restore[unit_axis]) {
+                log(ASYN_TRACE_ERROR, "FlexDC %s axis %d was reset or moved from its saved position %d, not restored\n", this->portName, axis, saved[axis].position);
+                continue;
+            }
+
+            log(ASYN_TRACE_FLOW, "FlexDC %s axis %d restored at %ld, homed=%d\n", this->portName, axis, positions[unit_axis], saved[axis].homed);
+            p_axis->positionReadback = positions[unit_axis];
+            setDoubleParam(axis, motorPosition_, positions[unit_axis]);
+            setDoubleParam(axis, motorEncoderPosition_, positions[unit_axis]);
+            setIntegerParam(axis, motorStatusHomed_, saved[axis].homed ? 1 : 0);
+            if ((saved[axis].motionEnd >= IN_MOTION) && (saved[axis].motionEnd <= BAD_PARAM)) {
+                p_axis->endMotionReason = (flexdcMotionEndReason)saved[axis].motionEnd;
+            }
+            this->snapshotAxes[axis] = saved[axis];
+            callParamCallbacks(axis);
+        }
+    }
+
+    // Any token of a previous run is replaced, so that the units cannot vouch for snapshots older than this run
+    epicsTimeGetCurrent(&now);
+    this->snapshotToken = (long)((now.secPastEpoch ^ now.nsec) & 0x7fffffff);
+    if (!this->snapshotToken) this->snapshotToken = 1;
+    FlexDCAxis::buildSnapshotTokenCommand(command, this->snapshotToken);
+    for (unit=0; unit<this->numUnits; unit++) {
+        this->units[unit].commandQueue->send(command, DEFAULT_CONTROLLER_TIMEOUT);
+    }
+}
+
+/** Checks the saved state of the axes of a unit against the reply to buildSnapshotCheckCommand().
+  * A unit only proves it kept its state if it still holds the token saved with the snapshot: a reset or power cycle clears it,
+  * even when it leaves the axes exactly where they were saved (e.g. at a home position of 0).
+  * Its axes are then restored if they are still within SNAPSHOT_POSITION_TOLERANCE of their saved position.
+  *
+  * \param[in,out] reply      The reply, split in place (empty if the query failed)
+  * \param[in]     saved      Saved state of the unit axes
+  * \param[in]     num_axes   Number of axes of the unit
+  * \param[in]     token      Token saved with the snapshot
+  * \param[out]    positions  Position read for each axis
+  * \param[out]    restore    Whether each axis can be restored
+  *
+  * \return Number of axes that can be restored
+  */
+int FlexDCController::checkSnapshot(char *reply, const FlexDCAxisSnapshot *saved, int num_axes, long token, long *positions, bool *restore) {
+    char *fields[CTRL_NUM_AXES+1];
+    long unit_token = 0;
+    int num_fields, axis, num_restored = 0;
+    bool continuous;
+
+    num_fields = FlexDCAxis::splitReply(reply, fields, num_axes+1);
+    continuous = (token != 0) && (num_fields == num_axes+1) && (FlexDCAxis::parseInteger(fields[num_axes], unit_token)) && (unit_token == token);
+
+    for (axis=0; axis<num_axes; axis++) {
+        positions[axis] = 0;
+        restore[axis] = (continuous) && (FlexDCAxis::parseInteger(fields[axis], positions[axis])) &&
+                        (labs(positions[axis]-saved[axis].position) <= SNAPSHOT_POSITION_TOLERANCE);
+        if (restore[axis]) num_restored++;
+    }
+
+    return num_restored;
+}
+
+/** Queues the state of all axes for the link thread to save to the snapshot file, if it changed since last saved.
+  * Nothing is saved until every axis was read from the controller, so that an unreachable controller
+  * at startup does not overwrite the last good snapshot.
+  * Called from the poller, with the controller lock held.
+  *
+  */
+void FlexDCController::saveSnapshot() {
+    FlexDCAxisSnapshot current[FLEXDC_MAX_UNITS*CTRL_NUM_AXES];
+    FlexDCAxis *p_axis;
+    int axis, homed;
+
+    memset(current, 0, sizeof(current));
+    for (axis=0; axis<this->numAxes_; axis++) {
+        p_axis = getAxis(axis);
+        if (!p_axis) continue;
+        if ((this->units[p_axis->unit].linkDown) || (!(p_axis->publishedMask & POLL_FIELD(POLL_READBACK)))) {
+            return;
+        }
+
+        getIntegerParam(axis, motorStatusHomed_, &homed);
+        current[axis].position = p_axis->positionReadback;
+        current[axis].homed = homed;
+        current[axis].motionEnd = p_axis->endMotionReason;
+    }
+
+    if (!memcmp(current, this->snapshotAxes, this->numAxes_*sizeof(*current))) {
+        return;
+    }
+
+    memcpy(this->pendingSnapshot, current, this->numAxes_*sizeof(*current));
+    this->snapshotQueued = true;
+    epicsEventSignal(this->linkEvent);
+}
+
+/** Writes the snapshot last queued by saveSnapshot(), if any, to the snapshot file.
+  * Called from the link thread: the records are copied under the controller lock, and written without it.
+  * A failed write is retried with the next snapshot queued, since the written one is only recorded on success.
+  *
+  */
+void FlexDCController::writeSnapshot() {
+    FlexDCAxisSnapshot axes[FLEXDC_MAX_UNITS*CTRL_NUM_AXES];
+    long token;
+    bool written;
+
+    lock();
+    if (!this->snapshotQueued) {
+        unlock();
+        return;
+    }
+    memcpy(axes, this->pendingSnapshot, this->numAxes_*sizeof(*axes));
+    token = this->snapshotToken;
+    this->snapshotQueued = false;
+    unlock();
+
+    written = FlexDCSnapshot::write(this->snapshotPath, axes, this->numAxes_, token);
+
+    lock();
+    if (written) {
+        memcpy(this->snapshotAxes, axes, this->numAxes_*sizeof(*axes));
+        this->snapshotFailed = false;
+    } else if (!this->snapshotFailed) {
+        log(ASYN_TRACE_ERROR, "Cannot write FlexDC %s snapshot to %s\n", this->portName, this->snapshotPath);
+        this->snapshotFailed = true;
+    }
+    unlock();
+}
+
+/** Publishes the exchange latencies of all units, by kind, and the poll cycle statistics on all axes.
+  * Called at most once per PUBLISH_REFRESH, since the histograms keep accumulating.
+  *
+  */
+void FlexDCController::publishStatistics() {
+    FlexDCLatencyHistogram histograms[NUM_EXCHANGE_KINDS], unit_histograms[NUM_EXCHANGE_KINDS];
+    double means[NUM_EXCHANGE_KINDS], maxes[NUM_EXCHANGE_KINDS], counts[NUM_EXCHANGE_KINDS];
+    FlexDCAxis *p_axis;
+    int unit, kind, axis;
+
+    for (unit=0; unit<this->numUnits; unit++) {
+        this->units[unit].commandQueue->getLatency(unit_histograms);
+        for (kind=0; kind<NUM_EXCHANGE_KINDS; kind++) {
+            histograms[kind].merge(unit_histograms[kind]);
+        }
+    }
+    for (kind=0; kind<NUM_EXCHANGE_KINDS; kind++) {
+        means[kind] = histograms[kind].mean()*1000.;
+        maxes[kind] = histograms[kind].max*1000.;
+        counts[kind] = histograms[kind].count;
+    }
+
+    for (axis=0; axis<this->numAxes_; axis++) {
+        setDoubleParam(axis, driverPollCycle, this->lastPollCycle*1000.);
+        setDoubleParam(axis, driverPollCycleMax, this->pollCycleStats.max*1000.);
+        setIntegerParam(axis, driverPollOverruns, (epicsInt32)this->pollOverruns);
+        doCallbacksFloat64Array(means, NUM_EXCHANGE_KINDS, driverLatencyMean, axis);
+        doCallbacksFloat64Array(maxes, NUM_EXCHANGE_KINDS, driverLatencyMax, axis);
+        doCallbacksFloat64Array(counts, NUM_EXCHANGE_KINDS, driverLatencyCount, axis);
+
+        p_axis = getAxis(axis);
+        if (p_axis) p_axis->paramsDirty = true;
+    }
 
-    numAxes = 2; // Force two-axes regardless of what user says
+    this->lastStatsPublishTime = this->pollCycleStart;
+}
 
-    // Connect to FlexDC controller
-    log(ASYN_TRACE_FLOW, "%s:%s: Creating Nanomotion FlexDC controller %s to asyn %s with %d axes\n", driverName, functionName, portName, asynPortName, numAxes);
-    status = pasynOctetSyncIO->connect(asynPortName, 0, &pasynUserController_, NULL);
-    if (status) {
-        log(ASYN_TRACE_ERROR, "%s:%s: Cannot connect to Nanomotion FlexDC controller at asyn %s\n", driverName, functionName, asynPortName);
-    } else {
-        pasynOctetSyncIO->getInputEos(pasynUserController_, eos, 10, &eos_len);
-        if (!eos_len) {
-            log(ASYN_TRACE_FLOW, "%s:%s: Setting input acknowledgement of %s to '>'\n", driverName, functionName, portName);
-            pasynOctetSyncIO->setInputEos(pasynUserController_, ">", 1);
-        }
+/** Clears all exchange latencies, including the largest stop latency, the poll cycle statistics and the move phase durations.
+  *
+  */
+void FlexDCController::resetStatistics() {
+    FlexDCAxis *p_axis;
+    int unit, axis, phase;
 
-        pasynOctetSyncIO->getOutputEos(pasynUserController_, eos, 10, &eos_len);
-        if (!eos_len) {
-            log(ASYN_TRACE_FLOW, "%s:%s: Setting output acknowledgement of %s to CR LF\n", driverName, functionName, portName);
-            pasynOctetSyncIO->setOutputEos(pasynUserController_, "\r\n", 2);
+    for (unit=0; unit<this->numUnits; unit++) {
+        this->units[unit].commandQueue->resetLatency();
+    }
+    for (axis=0; axis<this->numAxes_; axis++) {
+        p_axis = getAxis(axis);
+        if (!p_axis) continue;
+        for (phase=0; phase<NUM_MOVE_PHASES; phase++) {
+            p_axis->moveStats[phase].clear();
         }
+        p_axis->publishMoveStats();
     }
+    this->pollCycleStats.clear();
+    this->lastPollCycle = 0.0;
+    this->pollOverruns = 0;
 
-    // Create the axis objects
-    for (axis=0; axis<numAxes; axis++) {
-        new FlexDCAxis(this, axis);
+    publishStatistics();
+}
+
+/** Queues the command in outString_ for the first unit, and returns without waiting for it to be sent.
+  *
+  * \return asynSuccess if queued, asynError otherwise
+  */
+asynStatus FlexDCController::writeController() {
+    return writeController(0);
+}
+
+/** Queues the command in outString_ for a unit, and returns without waiting for it to be sent.
+  * Commands are sent in the order they are queued, pipelined with any other queued traffic of that unit.
+  *
+  * \param[in] unit  Index of the FlexDC unit
+  *
+  * \return asynSuccess if queued, asynError otherwise
+  */
+asynStatus FlexDCController::writeController(int unit) {
+    if ((unit < 0) || (unit >= this->numUnits)) {
+        return asynError;
     }
+    this->units[unit].replyCache.invalidate(this->outString_);
+    return this->units[unit].commandQueue->send(this->outString_, DEFAULT_CONTROLLER_TIMEOUT);
+}
 
-    startPoller(movingPollPeriod, idlePollPeriod, 2);
+/** Queues the command in outString_ for a unit, ahead of any of its pending query, and returns without waiting for it to be sent.
+  * Meant for commands that abort motion (stop, macro kill, reset).
+  *
+  * \param[in] unit    Index of the FlexDC unit
+  * \param[in] origin  When the triggering action started, to measure the latency until the command is written (can be NULL)
+  *
+  * \return asynSuccess if queued, asynError otherwise
+  */
+asynStatus FlexDCController::writePriorityController(int unit, const epicsTimeStamp *origin) {
+    if ((unit < 0) || (unit >= this->numUnits)) {
+        return asynError;
+    }
+    this->units[unit].replyCache.invalidate(this->outString_);
+    return this->units[unit].commandQueue->sendPriority(this->outString_, DEFAULT_CONTROLLER_TIMEOUT, origin);
 }
 
-/** Called when asyn clients call pasynInt32->write().
-  * Extracts the function and axis number from pasynUser.
-  * Sets the value in the parameter library.
-  * If the function is motorStop_ then it calls pAxis->stop().
-  * If the function is motorUpdateStatus_ then it does a poll and forces a callback.
-  * Calls any registered callbacks for this pasynUser->reason and address.  
-  * Motor drivers will reimplement this function if they support 
-  * controller-specific parameters on the asynInt32 interface. They should call this
-  * base class method for any parameters that are not controller-specific.
+/** Queues the command in outString_ for the first unit, and waits for its reply, which is copied into inString_.
   *
-  * \param[in] pasynUser asynUser structure that encodes the reason and address.
-  * \param[in] value     Value to write.
+  * \return Result of the write/read exchange
+  */
+asynStatus FlexDCController::writeReadController() {
+    return writeReadController(0);
+}
+
+/** Queues the command in outString_ for a unit, and waits for its reply, which is copied into inString_.
+  * Must be called with the controller lock held: the lock is released while waiting,
+  * so that other threads can queue their commands meanwhile.
   *
-  * \return Result of callParamCallbacks() call or asynMotorController::writeInt32()
+  * \param[in] unit  Index of the FlexDC unit
+  *
+  * \return Result of the write/read exchange
   */
-asynStatus FlexDCController::writeInt32(asynUser *pasynUser, epicsInt32 value) {
-    int function = pasynUser->reason;
-    asynMotorAxis *p_axis;
-    asynStatus status = asynSuccess;
-    const char* functionName = "writeInt32";
+asynStatus FlexDCController::writeReadController(int unit) {
+    FlexDCRequest *request = NULL;
 
-    p_axis = getAxis(pasynUser);
-    if (p_axis) {
-        if (function == driverResetController) {
-            p_axis->setIntegerParam(function, value);
+    if ((unit >= 0) && (unit < this->numUnits)) {
+        this->units[unit].replyCache.invalidate(this->outString_);
+        request = this->units[unit].commandQueue->post(this->outString_, true, DEFAULT_CONTROLLER_TIMEOUT);
+    }
+    if (!request) {
+        this->inString_[0] = '\0';
+        return asynError;
+    }
 
-            sprintf(this->outString_, CTRL_RESET_CMD);
-            writeController();
+    unlock();
+    this->units[unit].commandQueue->wait(request);
+    lock();
 
-            status = p_axis->callParamCallbacks();
-        } else {
-            status = asynMotorController::writeInt32(pasynUser, value);
-        }
-    } else {
-        log(ASYN_TRACE_ERROR, "Unable to retrieve FlexDC %s axis from asynUser in %s\n", this->portName, functionName);
-        status = asynError;
+    return this->units[unit].commandQueue->release(request, this->inString_, sizeof(this->inString_));
+}
+
+/** Same as writeReadController(int), but for queries of slow-changing values (version, speed...),
+  * answered from the reply cache of the unit when possible.
+  * Cached replies are dropped when a command assigning them is sent through this controller, on reset, and on reconnection.
+  *
+  * \param[in] unit     Index of the FlexDC unit
+  * \param[in] max_age  Oldest acceptable cached reply, in seconds
+  *
+  * \return Result of the write/read exchange, or asynSuccess if cached
+  */
+asynStatus FlexDCController::writeReadControllerCached(int unit, double max_age) {
+    asynStatus status;
+
+    if ((unit < 0) || (unit >= this->numUnits)) {
+        this->inString_[0] = '\0';
+        return asynError;
+    }
+    if (this->units[unit].replyCache.lookup(this->outString_, this->inString_, sizeof(this->inString_), max_age)) {
+        return asynSuccess;
     }
 
+    status = writeReadController(unit);
+    if (status == asynSuccess) {
+        this->units[unit].replyCache.store(this->outString_, this->inString_);
+    }
     return status;
 }
 
-
 /** Reports on status of the driver.
   * If level > 0 then error message, controller version is printed.
   *
@@ -171,23 +1819,48 @@ asynStatus FlexDCController::writeInt32(asynUser *pasynUser, epicsInt32 value) {
   * \param[in] level The level of report detail desired
   */
 void FlexDCController::report(FILE *fp, int level) {
+    FlexDCLatencyHistogram histograms[NUM_EXCHANGE_KINDS];
     asynStatus status = asynError;
+    int unit, kind;
 
-    fprintf(fp, "Nanomotion FlexDC motor controller %s, numAxes=%d, moving poll period=%f, idle poll period=%f\n", this->portName, numAxes_, movingPollPeriod_, idlePollPeriod_);
+    lock();
 
-    if (level > 0) {
-        // Retrieve controller version
-        sprintf(this->outString_, CTRL_VER_CMD);
-        status = writeReadController();
-        if (status == asynSuccess) {
-            fprintf(fp, "  version = %s\n", this->inString_);
-        } else {
-            log(ASYN_TRACE_ERROR, "Unable to retrieve FlexDC %s controller version\n", this->portName);
+    fprintf(fp, "Nanomotion FlexDC motor controller %s, numUnits=%d, numAxes=%d, moving poll period=%f, idle poll period=%f\n", this->portName, this->numUnits, numAxes_, movingPollPeriod_, idlePollPeriod_);
+
+    for (unit=0; unit<this->numUnits; unit++) {
+        fprintf(fp, "  unit %d on %s%s%s, %u reconnections\n", unit, this->units[unit].asynPortName, this->units[unit].pasynUser ? "" : " (not connected)",
+                this->units[unit].linkDown ? " (link down)" : "", (unsigned int)this->units[unit].reconnects);
+
+        if (level > 0) {
+            // Retrieve controller version
+            sprintf(this->outString_, CTRL_VER_CMD);
+            status = writeReadControllerCached(unit);
+            if (status == asynSuccess) {
+                fprintf(fp, "    version = %s\n", this->inString_);
+            } else {
+                log(ASYN_TRACE_ERROR, "Unable to retrieve FlexDC %s unit %d controller version\n", this->portName, unit);
+            }
         }
+
+        if (level > 1) {
+            // Exchange latencies, from write to reply
+            this->units[unit].commandQueue->getLatency(histograms);
+            for (kind=0; kind<NUM_EXCHANGE_KINDS; kind++) {
+                if (histograms[kind].count) histograms[kind].print(fp, EXCHANGE_KIND_NAMES[kind]);
+            }
+            fprintf(fp, "    reply cache: %lu hits, %lu misses\n", (unsigned long)this->units[unit].replyCache.hits, (unsigned long)this->units[unit].replyCache.misses);
+        }
+    }
+
+    if (level > 1) {
+        fprintf(fp, "  poll cycles, %lu overruns\n", (unsigned long)this->pollOverruns);
+        this->pollCycleStats.print(fp, "cycle");
     }
 
     // Call the base class method
     asynMotorController::report(fp, level);
+
+    unlock();
 }
 
 /** Returns a pointer to an FlexDCAxis object.
@@ -232,6 +1905,11 @@ void FlexDCController::log(int reason, const char *format, ...) {
   * \param[in] axisNo Index number of this axis, range 0 to pC->numAxes_-1
   */
 FlexDCAxis::FlexDCAxis(FlexDCController *pC, int axisNo): asynMotorAxis(pC, axisNo), pC_(pC) {
+    int signal;
+
+    this->unit = axisNo / CTRL_NUM_AXES;
+    this->unitAxis = axisNo % CTRL_NUM_AXES;
+
     this->motionStatus = 0;
     this->motorFault = 0;
     this->endMotionReason = MOTOR_OFF;
@@ -239,10 +1917,66 @@ FlexDCAxis::FlexDCAxis(FlexDCController *pC, int axisNo): asynMotorAxis(pC, axis
     this->positionError = 0;
     this->positionReadback = 0;
     this->isMotorOn = false;
+    this->targetPosition = 0;
+    this->deferredMove.pending = false;
+    this->profileCapturePositions = NULL;
+    this->profileCaptureErrors = NULL;
+    this->profileRecording = false;
+    this->profileRecordedPoints = 0;
+    this->captureRing = new FlexDCCaptureRing();
+    this->captureEnabled = false;
+    this->captureSkipped = 0;
+    this->capturePoints = 0;
+    this->captureTimes = (double *)calloc(FLEXDC_CAPTURE_POINTS, sizeof(double));
+    this->capturePositions = (double *)calloc(FLEXDC_CAPTURE_POINTS, sizeof(double));
+    this->captureErrors = (double *)calloc(FLEXDC_CAPTURE_POINTS, sizeof(double));
+    this->publishedDropped = 0;
+    this->recorderState = REC_IDLE;
+    this->recordPoints = 0;
+    this->recordLength = 0;
+    this->recordGap = 1;
+    this->recordTimes = NULL;
+    for (signal=0; signal<NUM_REC_SIGNALS; signal++) {
+        this->recordSignals[signal] = NULL;
+    }
+    this->programmedWindow = -1;
+    this->programmedSettleTime = -1;
+    this->homeStage = HOME_IDLE;
+    this->moveState = MOVE_UNTRACKED;
+    this->pollTier = TIER_IDLE;
+    epicsTimeGetCurrent(&this->lastPollTime);
+    this->motionGeneration = 0;
+    this->pollGeneration = 0;
+    this->polledValid = false;
+    this->polledMask = 0;
+    this->publishedMask = 0;
+    this->paramsDirty = false;
+    this->suppressedUpdates = 0;
+    this->lastPublishTime = this->lastPollTime;
 
     setIntegerParam(pC_->motorStatusHomed_, 0);
     setIntegerParam(pC_->motorStatusHasEncoder_, 1);
     setIntegerParam(pC_->motorClosedLoop_, 1);
+    setIntegerParam(pC_->driverPollMode, pC_->pollMode);
+    setDoubleParam(pC_->driverSettlePollPeriod, 0.0);
+    setDoubleParam(pC_->driverParkedPollPeriod, 0.0);
+    setDoubleParam(pC_->driverHomePollPeriod, 0.0);
+    setIntegerParam(pC_->driverHomeStage, HOME_IDLE);
+    setDoubleParam(pC_->driverStopTimeout, DEFAULT_STOP_TIMEOUT);
+    setIntegerParam(pC_->driverSettleWindow, 0);
+    setIntegerParam(pC_->driverSuppressedUpdates, 0);
+    setIntegerParam(pC_->driverSettleMode, SETTLE_IOC);
+    setDoubleParam(pC_->driverSettleTime, DEFAULT_SETTLE_TIME);
+    setIntegerParam(pC_->driverCapture, 0);
+    setIntegerParam(pC_->driverCaptureDecimation, 1);
+    setIntegerParam(pC_->driverCaptureDropped, 0);
+    setDoubleParam(pC_->driverCapturePeriod, DEFAULT_CAPTURE_PERIOD);
+    setIntegerParam(pC_->driverRecorderArm, 0);
+    setIntegerParam(pC_->driverRecorderState, REC_IDLE);
+    setIntegerParam(pC_->driverRecorderLength, FLEXDC_MAX_RECORD_POINTS/4);
+    setIntegerParam(pC_->driverRecorderGap, 1);
+    setIntegerParam(pC_->driverLinkUp, 1);
+    setIntegerParam(pC_->driverReconnects, 0);
     setStatusProblem(asynSuccess);
 
     callParamCallbacks();
@@ -256,11 +1990,11 @@ FlexDCAxis::FlexDCAxis(FlexDCController *pC, int axisNo): asynMotorAxis(pC, axis
   */
 void FlexDCAxis::report(FILE *fp, int level) {
     long speed;
-    int homr_type, homf_type;
+    int homr_type, homf_type, phase;
 
     if (level > 0) {
-        buildGenericGetCommand(pC_->outString_, AXIS_GETSPEED_CMD, this->axisNo_);
-        if (pC_->writeReadController() == asynSuccess) {
+        buildGenericGetCommand(pC_->outString_, AXIS_GETSPEED_CMD, this->unitAxis);
+        if (pC_->writeReadControllerCached(this->unit) == asynSuccess) {
             speed = atol(pC_->inString_);
         } else {
             speed = -1;
@@ -270,7 +2004,7 @@ void FlexDCAxis::report(FILE *fp, int level) {
         getIntegerParam(pC_->driverHomeForwardMacro, &homf_type);
 
         fprintf(fp,
-            "  axis %d\n"
+            "  axis %d (unit %d axis %c)\n"
             "    motion status = %x\n"
             "    motion end = %s\n"
             "    motor fault = %x\n"
@@ -281,6 +2015,8 @@ void FlexDCAxis::report(FILE *fp, int level) {
             "    homf type = %d\n"
             "    macro res.= %d\n",
             this->axisNo_,
+            this->unit,
+            CTRL_AXES[this->unitAxis],
             this->motionStatus,
             MOTION_END_REASON[this->endMotionReason],
             this->motorFault,
@@ -291,18 +2027,28 @@ void FlexDCAxis::report(FILE *fp, int level) {
             homf_type,
             this->macroResult
         );
+        fprintf(fp, "    capture = %d, %d points, %lu dropped\n", this->captureEnabled, this->capturePoints, (unsigned long)this->captureRing->getDropped());
+        fprintf(fp, "    recorder = %d, %d points\n", this->recorderState, this->recordPoints);
+        if (level > 1) {
+            for (phase=0; phase<NUM_MOVE_PHASES; phase++) {
+                fprintf(fp, "    %-8s moves=%d min=%.1f ms mean=%.1f ms p99=%.1f ms\n", MOVE_PHASE_NAMES[phase], this->moveStats[phase].count,
+                    this->moveStats[phase].min()*1000., this->moveStats[phase].mean()*1000., this->moveStats[phase].percentile(0.99)*1000.);
+            }
+        }
 
     } else {
        fprintf(fp,
-            "  axis %d\n",
-            this->axisNo_);
+            "  axis %d (unit %d axis %c)\n",
+            this->axisNo_,
+            this->unit,
+            CTRL_AXES[this->unitAxis]);
     }
 
     asynMotorAxis::report(fp, level);
 }
 
 /** Moves the axis to a different target position.
-  * Warning: stops any ongoing move or home actions!
+  * Warning: stops any ongoing move or home actions, and waits for the controller to report them stopped!
   *
   * \param[in] position      The desired target position
   * \param[in] relative      1 for relative position
@@ -316,24 +2062,46 @@ asynStatus FlexDCAxis::move(double position, int relative, double minVelocity, d
     asynStatus status = asynSuccess;
     long target = (long)position;
     int speed = (long)maxVelocity;
+    int settle_mode = SETTLE_IOC;
+    bool stopping = false;
 
     if (this->macroResult == EXECUTING) {
         status = haltHomingMacro();
-        shortWait();
+        stopping = true;
     }
     if ((status == asynSuccess) && (this->motionStatus != 0)) {
         status = stopMotor();
-        shortWait();
+        stopping = true;
     }
-    if (status == asynSuccess) {
+    if ((status == asynSuccess) && (stopping)) {
+        status = waitMotionStopped();
+    }
+    getIntegerParam(pC_->driverSettleMode, &settle_mode);
+    if ((status == asynSuccess) && (settle_mode == SETTLE_CONTROLLER)) {
+        status = programSettleWindow();
+    }
+    if ((status == asynSuccess) && (pC_->movesDeferred)) {
+        log(ASYN_TRACE_FLOW, "Deferring FlexDC %s axis %d move to %ld at velocity %d\n", pC_->portName, this->axisNo_, target, speed);
+
+        this->deferredMove.pending = true;
+        this->deferredMove.relative = relative;
+        this->deferredMove.position = target;
+        this->deferredMove.velocity = speed;
+    } else if (status == asynSuccess) {
         log(ASYN_TRACE_FLOW, "Moving FlexDC %s axis %d to %ld at velocity %d\n", pC_->portName, this->axisNo_, target, speed);
 
         setIntegerParam(pC_->motorStatusDone_, 0);
+        this->targetPosition = relative ? this->positionReadback+target : target;
+        this->pollTier = TIER_MOVING;
 
-        buildMoveCommand(pC_->outString_, this->axisNo_, target, relative, speed);
-        status = pC_->writeController();
+        newMotionGeneration();
+        buildMoveCommand(pC_->outString_, this->unitAxis, target, relative, speed);
+        status = pC_->writeController(this->unit);
         if (status != asynSuccess) {
             setIntegerParam(pC_->motorStatusDone_, 1);
+        } else {
+            this->moveState = MOVE_SENT;
+            epicsTimeGetCurrent(&this->moveTimes[MOVE_SENT]);
         }
     }
 
@@ -343,7 +2111,7 @@ asynStatus FlexDCAxis::move(double position, int relative, double minVelocity, d
 }
 
 /** Starts the axis homing macro, as defined in the HOMR_CMD or HOMF_CMD records.
-  * Warning: stops any ongoing move or home actions!
+  * Warning: stops any ongoing move or home actions, and waits for the controller to report them stopped!
   *
   * \param[in] minVelocity   Motion parameter
   * \param[in] maxVelocity   Motion parameter
@@ -355,15 +2123,20 @@ asynStatus FlexDCAxis::move(double position, int relative, double minVelocity, d
 asynStatus FlexDCAxis::home(double minVelocity, double maxVelocity, double acceleration, int forwards) {
     asynStatus status = asynSuccess;
     int hom_type;
+    bool stopping = false;
 
     if (this->macroResult == EXECUTING) {
         status = haltHomingMacro();
-        shortWait();
+        stopping = true;
     }
     if ((status == asynSuccess) && (this->motionStatus != 0)) {
         status = stopMotor();
-        shortWait();
+        stopping = true;
     }
+    if ((status == asynSuccess) && (stopping)) {
+        status = waitMotionStopped();
+    }
+    this->moveState = MOVE_UNTRACKED;
 
     if (status == asynSuccess) {
         if (forwards) {
@@ -382,12 +2155,17 @@ asynStatus FlexDCAxis::home(double minVelocity, double maxVelocity, double accel
             setIntegerParam(pC_->motorStatusDone_, 0);
             setIntegerParam(pC_->motorStatusHome_, 1);
             setIntegerParam(pC_->motorStatusHomed_, 0);
+            setHomeStage(HOME_STARTED);
+            this->pollTier = TIER_HOMING;
 
-            buildHomeMacroCommand(pC_->outString_, this->axisNo_, forwards, static_cast<flexdcHomeMacro>(hom_type));
-            status = pC_->writeController();
+            newMotionGeneration();
+            buildHomeMacroCommand(pC_->outString_, this->unitAxis, forwards, static_cast<flexdcHomeMacro>(hom_type));
+            status = pC_->writeController(this->unit);
             if (status != asynSuccess) {
                 setIntegerParam(pC_->motorStatusHome_, 0);
                 setIntegerParam(pC_->motorStatusDone_, 1);
+                setHomeStage(HOME_FAILED);
+                this->pollTier = TIER_IDLE;
             }
 
         } else {
@@ -413,77 +2191,551 @@ asynStatus FlexDCAxis::home(double minVelocity, double maxVelocity, double accel
   */
 asynStatus FlexDCAxis::stop(double acceleration) {
     asynStatus status = asynError;
+    epicsTimeStamp stop_time;
+
+    epicsTimeGetCurrent(&stop_time);
 
+    // Interrupted moves would skew the move phase durations
+    this->moveState = MOVE_UNTRACKED;
+    this->deferredMove.pending = false;
     if (this->macroResult == EXECUTING) {
-        haltHomingMacro();
+        haltHomingMacro(&stop_time);
+    }
+    status = stopMotor(&stop_time);
+    setStatusProblem(status);
+
+    return callParamCallbacks();
+}
+
+/** Forces the axis readback position to some value.
+  * Warning: if motor is movinr or homing, nothing is done!
+  *
+  * \param[in] position  The desired readback position
+  *
+  * \return Result of callParamCallbacks() call
+  */
+asynStatus FlexDCAxis::setPosition(double position) {
+    asynStatus status = asynError;
+
+    if ((this->macroResult == EXECUTING) || (this->motionStatus != 0)) {
+        log(ASYN_TRACE_ERROR, "Due to ongoing motion of FlexDC %s axis %d, readback position will not be overriden!\n", pC_->portName, this->axisNo_);
+    } else {
+        buildSetPositionCommand(pC_->outString_, this->unitAxis, position);
+        status = pC_->writeController(this->unit);
+        this->pollTier = TIER_IDLE;
     }
-    status = stopMotor();
+
     setStatusProblem(status);
 
     return callParamCallbacks();
 }
 
-/** Forces the axis readback position to some value.
-  * Warning: if motor is movinr or homing, nothing is done!
+/** Polls the axis.
+  * Reads the states, limits, readback, etc. and calls setIntegerParam() or setDoubleParam() for each polled item that changed.
+  * If motor is stopped and the position error is less than RDBD field, then motor is switched off.
+  * Depending on the controller poll mode, the status is queried one command at a time or in a single batched exchange,
+  * or was already fetched together with the other axes by FlexDCController::poll().
+  *
+  * \param[out] moving A flag that is set indicating that the axis is moving (1) or done (0)
+  *
+  * \return Result of pollAxis() call
+  */
+asynStatus FlexDCAxis::poll(bool *moving) {
+    asynStatus status = pollAxis(moving);
+
+    // The poller polls the axes in order, so the last one ends the poll cycle
+    pC_->pollCycleMoving = pC_->pollCycleMoving || *moving;
+    if (this->axisNo_ == pC_->numAxes_-1) {
+        pC_->endPollCycle();
+    }
+
+    return status;
+}
+
+/** Polls the axis status and publishes it.
+  *
+  * \param[out] moving A flag that is set indicating that the axis is moving (1) or done (0)
+  *
+  * \return Result of publishParams() call
+  */
+asynStatus FlexDCAxis::pollAxis(bool *moving) {
+    asynStatus status[NUM_POLL_FIELDS];
+    char *fields[NUM_POLL_FIELDS];
+    char buffer[MAX_CONTROLLER_STRING_SIZE];
+    unsigned int mask;
+    int status_done;
+
+    drainCapture();
+
+    if (pC_->units[this->unit].linkDown) {
+        // Nothing to exchange until the connection supervisor brings the unit back
+        getIntegerParam(pC_->motorStatusDone_, &status_done);
+        *moving = !status_done;
+        return publishParams();
+    }
+
+    if (this->polledValid) {
+        // Status fetched by the controller poll in this same poller cycle
+        this->polledValid = false;
+        return updatePollFields(this->polledMask, this->polledStatus, this->polledFields, moving);
+    }
+
+    mask = selectPollFields();
+    if (!mask) {
+        // Nothing due in this cycle
+        getIntegerParam(pC_->motorStatusDone_, &status_done);
+        *moving = !status_done;
+        return asynSuccess;
+    }
+
+    this->pollGeneration = this->motionGeneration;
+    if (pC_->pollMode == POLL_SEQUENTIAL) {
+        queryPollFields(mask, status, fields, buffer, sizeof(buffer));
+    } else {
+        queryPollFieldsBatch(mask, status, fields, buffer, sizeof(buffer));
+    }
+
+    return updatePollFields(mask, status, fields, moving);
+}
+
+/** Allocates the profile arrays of the axis, including those holding the values captured during execution.
+  *
+  * \param[in] maxPoints  Maximum number of profile points
+  *
+  * \return Result of asynMotorAxis::initializeProfile()
+  */
+asynStatus FlexDCAxis::initializeProfile(size_t maxPoints) {
+    if (this->profileCapturePositions) free(this->profileCapturePositions);
+    if (this->profileCaptureErrors) free(this->profileCaptureErrors);
+    this->profileCapturePositions = (double *)calloc(maxPoints, sizeof(double));
+    this->profileCaptureErrors = (double *)calloc(maxPoints, sizeof(double));
+
+    return asynMotorAxis::initializeProfile(maxPoints);
+}
+
+/** Clears the capture history and restarts its time axis.
+  * Called with the controller lock held, when capture is enabled.
+  *
+  */
+void FlexDCAxis::startCapture() {
+    this->captureRing->clear();
+    this->captureSkipped = 0;
+    this->capturePoints = 0;
+    epicsTimeGetCurrent(&this->captureStartTime);
+}
+
+/** Moves the samples taken by the capture thread from the ring into the capture waveforms, keeping one out of every decimation samples.
+  * The waveforms hold the last FLEXDC_CAPTURE_POINTS kept samples, oldest first, with their time in seconds since capture was started;
+  * they are only published if new samples were kept.
+  *
+  */
+void FlexDCAxis::drainCapture() {
+    FlexDCSample samples[64];
+    double times[64], positions[64], errors[64];
+    int decimation, num_samples, sample, num_kept, shift;
+    bool any_kept = false;
+    size_t dropped;
+
+    dropped = this->captureRing->getDropped();
+    if (dropped != this->publishedDropped) {
+        setIntegerParam(pC_->driverCaptureDropped, (epicsInt32)dropped);
+        this->publishedDropped = dropped;
+        this->paramsDirty = true;
+    }
+    if (!this->captureEnabled) {
+        return;
+    }
+
+    getIntegerParam(pC_->driverCaptureDecimation, &decimation);
+    if (decimation < 1) decimation = 1;
+
+    while ((num_samples = (int)this->captureRing->pop(samples, sizeof(samples)/sizeof(*samples)))) {
+        num_kept = 0;
+        for (sample=0; sample<num_samples; sample++) {
+            if (++this->captureSkipped < decimation) continue;
+            this->captureSkipped = 0;
+
+            times[num_kept] = epicsTimeDiffInSeconds(&samples[sample].time, &this->captureStartTime);
+            positions[num_kept] = (double)samples[sample].position;
+            errors[num_kept] = (double)samples[sample].error;
+            num_kept++;
+        }
+        if (!num_kept) continue;
+
+        // Roll the oldest samples out to make room
+        shift = this->capturePoints + num_kept - FLEXDC_CAPTURE_POINTS;
+        if (shift > 0) {
+            this->capturePoints -= shift;
+            memmove(this->captureTimes, this->captureTimes+shift, this->capturePoints*sizeof(double));
+            memmove(this->capturePositions, this->capturePositions+shift, this->capturePoints*sizeof(double));
+            memmove(this->captureErrors, this->captureErrors+shift, this->capturePoints*sizeof(double));
+        }
+        memcpy(this->captureTimes+this->capturePoints, times, num_kept*sizeof(double));
+        memcpy(this->capturePositions+this->capturePoints, positions, num_kept*sizeof(double));
+        memcpy(this->captureErrors+this->capturePoints, errors, num_kept*sizeof(double));
+        this->capturePoints += num_kept;
+        any_kept = true;
+    }
+
+    if (any_kept) {
+        pC_->doCallbacksFloat64Array(this->captureTimes, this->capturePoints, pC_->driverCaptureTimes, this->axisNo_);
+        pC_->doCallbacksFloat64Array(this->capturePositions, this->capturePoints, pC_->driverCapturePositions, this->axisNo_);
+        pC_->doCallbacksFloat64Array(this->captureErrors, this->capturePoints, pC_->driverCaptureErrors, this->axisNo_);
+    }
+}
+
+/** Configures and arms the on-board recorder of the axis, as set by its REC records, to start recording on the next begin.
+  * The recorded vectors are read back by the recorder thread once the recorder reports it has finished.
+  *
+  * \return Result of startRecorder() call
+  */
+asynStatus FlexDCAxis::armRecorder() {
+    int gap, length;
+
+    getIntegerParam(pC_->driverRecorderGap, &gap);
+    getIntegerParam(pC_->driverRecorderLength, &length);
+    this->profileRecording = false;
+
+    return startRecorder(gap, length);
+}
+
+/** Arms the on-board recorder of the axis to record a whole profile, from its begin on.
+  * The gap between samples is the smallest that fits the profile duration in the recorder.
+  *
+  * \param[in] duration  Duration of the profile, in seconds
+  *
+  * \return Result of startRecorder() call, or asynError if the servo sample time could not be read
+  */
+asynStatus FlexDCAxis::armProfileRecorder(double duration) {
+    asynStatus status;
+    long sample_time = 0;
+    int gap, length;
+
+    this->profileRecording = false;
+    this->profileRecordedPoints = 0;
+
+    // Servo sample time, in us
+    buildGenericGetCommand(pC_->outString_, AXIS_SAMPLE_TIME_CMD, this->unitAxis);
+    status = pC_->writeReadControllerCached(this->unit);
+    if ((status != asynSuccess) || (!parseInteger(pC_->inString_, sample_time, 1))) {
+        log(ASYN_TRACE_ERROR, "Unable to read FlexDC %s axis %d sample time\n", pC_->portName, this->axisNo_);
+        return asynError;
+    }
+
+    gap = (int)ceil(duration*1.e6/sample_time/(FLEXDC_MAX_RECORD_POINTS-1));
+    if (gap < 1) gap = 1;
+    length = (int)ceil(duration*1.e6/sample_time/gap)+1;
+    if (length > FLEXDC_MAX_RECORD_POINTS) length = FLEXDC_MAX_RECORD_POINTS;
+
+    status = startRecorder(gap, length);
+    this->profileRecording = (status == asynSuccess);
+    return status;
+}
+
+/** Configures and arms the on-board recorder of the axis, to start recording on the next begin.
+  *
+  * \param[in] gap     Servo samples between recorded points
+  * \param[in] length  Number of points to record
+  *
+  * \return Result of the arm command, or asynError if the recorder length or gap is invalid
+  */
+asynStatus FlexDCAxis::startRecorder(int gap, int length) {
+    asynStatus status = asynError;
+    int signal;
+
+    if (!this->recordTimes) {
+        this->recordTimes = (double *)calloc(FLEXDC_MAX_RECORD_POINTS, sizeof(double));
+        for (signal=0; signal<NUM_REC_SIGNALS; signal++) {
+            this->recordSignals[signal] = (double *)calloc(FLEXDC_MAX_RECORD_POINTS, sizeof(double));
+        }
+    }
+
+    if (buildRecorderArmCommand(pC_->outString_, this->unitAxis, gap, length)) {
+        log(ASYN_TRACE_FLOW, "Arming FlexDC %s axis %d recorder for %d points every %d samples\n", pC_->portName, this->axisNo_, length, gap);
+        status = pC_->writeController(this->unit);
+    } else {
+        log(ASYN_TRACE_ERROR, "Unable to build FlexDC %s axis %d recorder arm command\n", pC_->portName, this->axisNo_);
+    }
+
+    if (status == asynSuccess) {
+        this->recordLength = length;
+        this->recordGap = gap;
+        setRecorderState(REC_ARMED);
+    } else {
+        setRecorderState(REC_FAILED);
+    }
+
+    return status;
+}
+
+/** Checks whether an armed recorder has finished, and if so reads its vectors back.
+  * Called by the recorder thread, with the controller lock held (released during the exchanges);
+  * costs a single query while armed, nothing otherwise.
+  *
+  */
+void FlexDCAxis::updateRecorder() {
+    long recorder_status;
+
+    if (this->recorderState != REC_ARMED) {
+        return;
+    }
+
+    buildGenericGetCommand(pC_->outString_, AXIS_REC_STATUS_CMD, this->unitAxis);
+    if ((pC_->writeReadController(this->unit) == asynSuccess) && (parseInteger(pC_->inString_, recorder_status)) && (recorder_status == 0)) {
+        readRecorder();
+    }
+}
+
+/** Reads back the recorded position, position error and current vectors, and publishes them with their time axis,
+  * in seconds since the recorder was triggered.
+  *
+  * \return Result of the array downloads
+  */
+asynStatus FlexDCAxis::readRecorder() {
+    asynStatus status;
+    long sample_time = 0;
+    int signal, point, sample, num_points = 0;
+
+    setRecorderState(REC_READING);
+
+    // Servo sample time, in us
+    buildGenericGetCommand(pC_->outString_, AXIS_SAMPLE_TIME_CMD, this->unitAxis);
+    status = pC_->writeReadController(this->unit);
+    if ((status == asynSuccess) && (!parseInteger(pC_->inString_, sample_time, 1))) {
+        status = asynError;
+    }
+
+    for (signal=0; (signal<NUM_REC_SIGNALS) && (status == asynSuccess); signal++) {
+        status = pC_->downloadArray(this->unit, this->unitAxis, AXIS_REC_ARRAYS[signal], this->recordSignals[signal], this->recordLength);
+    }
+    if (status != asynSuccess) {
+        log(ASYN_TRACE_ERROR, "Unable to read FlexDC %s axis %d recorder\n", pC_->portName, this->axisNo_);
+        setRecorderState(REC_FAILED);
+        return status;
+    }
+
+    this->recordPoints = this->recordLength;
+    for (point=0; point<this->recordPoints; point++) {
+        this->recordTimes[point] = point*this->recordGap*sample_time/1.e6;
+    }
+
+    if ((this->profileRecording) && (this->profileCapturePositions)) {
+        // Each profile point gets the sample recorded closest to its time since the begin
+        this->profileRecording = false;
+        pC_->getIntegerParam(pC_->profileNumPoints_, &num_points);
+        for (point=0; point<num_points; point++) {
+            sample = (int)(pC_->profilePointTimes[point]/(this->recordGap*sample_time/1.e6)+0.5);
+            if (sample >= this->recordPoints) sample = this->recordPoints-1;
+            this->profileCapturePositions[point] = this->recordSignals[REC_POSITION][sample];
+            this->profileCaptureErrors[point] = this->recordSignals[REC_POSITION_ERROR][sample];
+        }
+        this->profileRecordedPoints = num_points;
+    }
+
+    pC_->doCallbacksFloat64Array(this->recordTimes, this->recordPoints, pC_->driverRecordTimes, this->axisNo_);
+    pC_->doCallbacksFloat64Array(this->recordSignals[REC_POSITION], this->recordPoints, pC_->driverRecordPositions, this->axisNo_);
+    pC_->doCallbacksFloat64Array(this->recordSignals[REC_POSITION_ERROR], this->recordPoints, pC_->driverRecordErrors, this->axisNo_);
+    pC_->doCallbacksFloat64Array(this->recordSignals[REC_CURRENT], this->recordPoints, pC_->driverRecordCurrents, this->axisNo_);
+
+    setRecorderState(REC_DONE);
+    return asynSuccess;
+}
+
+/** Updates and publishes the recorder state.
+  *
+  * \param[in] state  New state
+  */
+void FlexDCAxis::setRecorderState(flexdcRecorderState state) {
+    this->recorderState = state;
+    setIntegerParam(pC_->driverRecorderState, state);
+    callParamCallbacks();
+}
+
+/** Selects which status fields are due in this poll cycle, depending on the poll tier.
+  * Homing axes only get their macro result and motion status polled, until the macro is over.
+  * Parked axes (done and switched off) only get their readback and fault polled, every parked poll period.
+  *
+  * \return Bit mask of POLL_FIELD() values, 0 if nothing is due
+  */
+unsigned int FlexDCAxis::selectPollFields() {
+    epicsTimeStamp now;
+    double parked_period = 0.0;
+    int settle_mode = SETTLE_IOC;
+
+    if (this->pollTier == TIER_HOMING) {
+        return POLL_HOME_FIELDS;
+    }
+    if (this->pollTier == TIER_SETTLING) {
+        // The controller tells when settled, position error and motion end are read once done
+        getIntegerParam(pC_->driverSettleMode, &settle_mode);
+        return (settle_mode == SETTLE_CONTROLLER) ? POLL_SETTLE_FIELDS : POLL_ALL_FIELDS;
+    }
+    if (this->pollTier != TIER_PARKED) {
+        return POLL_ALL_FIELDS;
+    }
+
+    getDoubleParam(pC_->driverParkedPollPeriod, &parked_period);
+    epicsTimeGetCurrent(&now);
+    if (epicsTimeDiffInSeconds(&now, &this->lastPollTime) < parked_period/1000.) {
+        return 0;
+    }
+    return POLL_PARKED_FIELDS;
+}
+
+/** Re-evaluates the poll tier from the latest axis status.
+  *
+  */
+void FlexDCAxis::updatePollTier() {
+    int status_done, settle_window = 0;
+
+    getIntegerParam(pC_->motorStatusDone_, &status_done);
+    getIntegerParam(pC_->driverSettleWindow, &settle_window);
+
+    if (!status_done) {
+        if ((this->macroResult == EXECUTING) && (this->homeStage != HOME_IDLE) && (this->homeStage < HOME_DONE)) {
+            this->pollTier = TIER_HOMING;
+        } else if ((this->macroResult != EXECUTING) &&
+            ((this->motionStatus == 0) || (labs(this->targetPosition-this->positionReadback) <= settle_window))) {
+            this->pollTier = TIER_SETTLING;
+        } else {
+            this->pollTier = TIER_MOVING;
+        }
+    } else if ((this->isMotorOn) || (this->macroResult == EXECUTING)) {
+        this->pollTier = TIER_IDLE;
+    } else {
+        this->pollTier = TIER_PARKED;
+    }
+}
+
+/** Queries the axis status with one controller exchange per field.
   *
-  * \param[in] position  The desired readback position
+  * \param[in]  mask         Fields to query, see POLL_FIELD()
+  * \param[out] status       Exchange status of each field
+  * \param[out] fields       Reply of each field, pointing into buffer
+  * \param[in]  buffer       Storage for the replies
+  * \param[in]  buffer_size  Size of buffer
+  */
+void FlexDCAxis::queryPollFields(unsigned int mask, asynStatus *status, char **fields, char *buffer, size_t buffer_size) {
+    size_t reply_len;
+    int field;
+
+    for (field=0; field<NUM_POLL_FIELDS; field++) {
+        if (!(mask & POLL_FIELD(field))) continue;
+
+        buildGenericGetCommand(pC_->outString_, AXIS_POLL_CMDS[field], this->unitAxis);
+        status[field] = pC_->writeReadController(this->unit);
+
+        reply_len = strlen(pC_->inString_);
+        if (reply_len+1 < buffer_size) {
+            memcpy(buffer, pC_->inString_, reply_len+1);
+            fields[field] = buffer;
+            buffer += reply_len+1;
+            buffer_size -= reply_len+1;
+        } else {
+            status[field] = asynOverflow;
+            fields[field] = buffer+buffer_size-1;
+            *fields[field] = '\0';
+        }
+    }
+}
+
+/** Queries the axis status in a single controller exchange, by chaining all queries with CMD_SEPARATOR.
   *
-  * \return Result of callParamCallbacks() call
+  * \param[in]  mask         Fields to query, see POLL_FIELD()
+  * \param[out] status       Exchange status of each field (asynError if the field is missing from the reply)
+  * \param[out] fields       Reply of each field, pointing into buffer
+  * \param[in]  buffer       Storage for the reply
+  * \param[in]  buffer_size  Size of buffer
   */
-asynStatus FlexDCAxis::setPosition(double position) {
-    asynStatus status = asynError;
+void FlexDCAxis::queryPollFieldsBatch(unsigned int mask, asynStatus *status, char **fields, char *buffer, size_t buffer_size) {
+    asynStatus batch_status;
+    char *replies[NUM_POLL_FIELDS];
+    int field, num_fields = 0, num_expected = 0, reply_field = 0;
 
-    if ((this->macroResult == EXECUTING) || (this->motionStatus != 0)) {
-        log(ASYN_TRACE_ERROR, "Due to ongoing motion of FlexDC %s axis %d, readback position will not be overriden!\n", pC_->portName, this->axisNo_);
-    } else {
-        buildSetPositionCommand(pC_->outString_, this->axisNo_, position);
-        status = pC_->writeController();
+    for (field=0; field<NUM_POLL_FIELDS; field++) {
+        if (mask & POLL_FIELD(field)) num_expected++;
     }
 
-    setStatusProblem(status);
+    buildPollCommand(pC_->outString_, this->unitAxis, mask);
+    batch_status = pC_->writeReadController(this->unit);
 
-    return callParamCallbacks();
+    strncpy(buffer, pC_->inString_, buffer_size-1);
+    buffer[buffer_size-1] = '\0';
+    if (batch_status == asynSuccess) {
+        num_fields = splitReply(buffer, replies, num_expected);
+        if (num_fields != num_expected) {
+            log(ASYN_TRACE_ERROR, "FlexDC %s axis %d replied %d out of %d poll fields\n", pC_->portName, this->axisNo_, num_fields, num_expected);
+        }
+    }
+
+    for (field=0; field<NUM_POLL_FIELDS; field++) {
+        if (!(mask & POLL_FIELD(field))) continue;
+
+        if (reply_field < num_fields) {
+            status[field] = batch_status;
+            fields[field] = replies[reply_field];
+        } else {
+            status[field] = (batch_status == asynSuccess) ? asynError : batch_status;
+            fields[field] = buffer+strlen(buffer);
+        }
+        reply_field++;
+    }
 }
 
-/** Polls the axis.
-  * Reads the states, limits, readback, etc. and calls setIntegerParam() or setDoubleParam() for each item that it polls.
-  * If motor is stopped and the position error is less than RDBD field, then motor is switched off.
+/** Updates the axis from the replies of a poll, then re-evaluates its poll tier.
+  * The lock is released while a poll is in flight, so a motion command may have been sent meanwhile:
+  * the motion fields of a poll requested before the last motion command predate it, and are ignored.
   *
-  * \param[out] moving A flag that is set indicating that the axis is moving (1) or done (0)
+  * \param[in]  mask    Fields that were queried, see POLL_FIELD()
+  * \param[in]  status  Exchange status of each field
+  * \param[in]  fields  Reply of each field
+  * \param[out] moving  A flag that is set indicating that the axis is moving (1) or done (0)
   *
-  * \return Result of callParamCallbacks() call
+  * \return Result of publishParams() call
   */
-asynStatus FlexDCAxis::poll(bool *moving) { 
-    asynStatus status = asynError, final_status = asynSuccess;
+asynStatus FlexDCAxis::updatePollFields(unsigned int mask, const asynStatus *status, char * const *fields, bool *moving) {
+    asynStatus final_status = asynSuccess;
     int at_limit, is_homing;
     int status_done;
+    int settle_mode = SETTLE_IOC;
+    long previous_readback = this->positionReadback;
     bool valid_motion_status = false, valid_macro_result = false, valid_ispowered = false;
 
-    buildGenericGetCommand(pC_->outString_, AXIS_GETPOS_CMD, this->axisNo_);
-    status = pC_->writeReadController();
-    if (updateAxisReadbackPosition(status, pC_->inString_, this->positionReadback, &final_status)) {
+    epicsTimeGetCurrent(&this->lastPollTime);
+    getIntegerParam(pC_->driverSettleMode, &settle_mode);
+    if (this->pollGeneration != this->motionGeneration) {
+        mask &= ~POLL_MOTION_FIELDS;
+    }
+
+    if ((mask & POLL_FIELD(POLL_READBACK)) &&
+        (updateAxisReadbackPosition(status[POLL_READBACK], fields[POLL_READBACK], this->positionReadback, &final_status)) &&
+        (publishField(POLL_READBACK, this->positionReadback))) {
         setDoubleParam(pC_->motorEncoderPosition_, this->positionReadback);
         setDoubleParam(pC_->motorPosition_, this->positionReadback);
     }
 
-    buildGenericGetCommand(pC_->outString_, AXIS_ISPOWERED_CMD, this->axisNo_);
-    status = pC_->writeReadController();
-    if ((valid_ispowered = updateAxisMotorPower(status, pC_->inString_, this->isMotorOn, &final_status))) {
+    if ((mask & POLL_FIELD(POLL_POWER)) &&
+        (valid_ispowered = updateAxisMotorPower(status[POLL_POWER], fields[POLL_POWER], this->isMotorOn, &final_status)) &&
+        (publishField(POLL_POWER, this->isMotorOn))) {
         setIntegerParam(pC_->motorStatusPowerOn_, this->isMotorOn);
     }
 
-    buildGenericGetCommand(pC_->outString_, AXIS_MOTIONSTATUS_CMD, this->axisNo_);
-    status = pC_->writeReadController();
-    valid_motion_status = updateAxisMotionStatus(status, pC_->inString_, this->motionStatus, &final_status);
+    if (mask & POLL_FIELD(POLL_MOTION_STATUS)) {
+        if ((valid_motion_status = updateAxisMotionStatus(status[POLL_MOTION_STATUS], fields[POLL_MOTION_STATUS], this->motionStatus, &final_status))) {
+            publishField(POLL_MOTION_STATUS, this->motionStatus);
+        }
+    }
 
-    buildGenericGetCommand(pC_->outString_, AXIS_MACRO_RESULT_CMD, this->axisNo_);
-    status = pC_->writeReadController();
-    if ((valid_macro_result = updateAxisMacroResult(status, pC_->inString_, this->macroResult, &final_status))) {
-        setIntegerParam(pC_->driverHomeStatus, this->macroResult);
+    if ((mask & POLL_FIELD(POLL_MACRO_RESULT)) &&
+        (valid_macro_result = updateAxisMacroResult(status[POLL_MACRO_RESULT], fields[POLL_MACRO_RESULT], this->macroResult, &final_status))) {
+        if (publishField(POLL_MACRO_RESULT, this->macroResult)) {
+            setIntegerParam(pC_->driverHomeStatus, this->macroResult);
+        }
 
         getIntegerParam(pC_->motorStatusHome_, &is_homing);
         if ((this->macroResult != EXECUTING) && (is_homing)) {
             pC_->setIntegerParam(pC_->motorStatusHome_, 0);
+            this->paramsDirty = true;
 
             if (this->macroResult == OK) {
                 log(ASYN_TRACE_FLOW, "FlexDC %s axis %d is now homed\n", pC_->portName, this->axisNo_);
@@ -494,46 +2746,108 @@ asynStatus FlexDCAxis::poll(bool *moving) {
         }
     }
 
-    buildGenericGetCommand(pC_->outString_, AXIS_MOTIONEND_CMD, this->axisNo_);
-    status = pC_->writeReadController();
-    if (updateAxisMotionEnd(status, pC_->inString_, this->endMotionReason, &final_status)) {
+    if ((mask & POLL_FIELD(POLL_MOTION_END)) &&
+        (updateAxisMotionEnd(status[POLL_MOTION_END], fields[POLL_MOTION_END], this->endMotionReason, &final_status))) {
+        publishField(POLL_MOTION_END, this->endMotionReason);
+
         getIntegerParam(pC_->motorStatusLowLimit_, &at_limit);
         if ((this->endMotionReason == HARD_RLS) && (!at_limit)) {
             log(ASYN_TRACE_FLOW, "FlexDC %s axis %d at low limit switch\n", pC_->portName, this->axisNo_);
             setIntegerParam(pC_->motorStatusLowLimit_, 1);
+            this->paramsDirty = true;
             switchMotorPower(false);
         } else if ((this->endMotionReason != HARD_RLS) && (this->endMotionReason != MOTOR_OFF) && (at_limit)) {
             setIntegerParam(pC_->motorStatusLowLimit_, 0);
+            this->paramsDirty = true;
         }
 
         getIntegerParam(pC_->motorStatusHighLimit_, &at_limit);
         if ((this->endMotionReason == HARD_FLS) && (!at_limit)) {
             log(ASYN_TRACE_FLOW, "FlexDC %s axis %d at high limit switch\n", pC_->portName, this->axisNo_);
             setIntegerParam(pC_->motorStatusHighLimit_, 1);
+            this->paramsDirty = true;
             switchMotorPower(false);
         } else if ((this->endMotionReason != HARD_FLS) && (this->endMotionReason != MOTOR_OFF) && (at_limit)) {
             setIntegerParam(pC_->motorStatusHighLimit_, 0);
+            this->paramsDirty = true;
+        }
+    }
+
+    if ((mask & POLL_FIELD(POLL_POSITION_ERROR)) &&
+        (updateAxisPositionError(status[POLL_POSITION_ERROR], fields[POLL_POSITION_ERROR], this->positionError, &final_status))) {
+        publishField(POLL_POSITION_ERROR, this->positionError);
+
+        getIntegerParam(pC_->motorStatusDone_, &status_done);
+        if ((settle_mode == SETTLE_IOC) && (valid_macro_result) && (valid_motion_status) && (valid_ispowered) && (!status_done)) {
+            setMotionDone(this->motionStatus, this->macroResult, this->isMotorOn, this->positionError);
         }
     }
 
-    buildGenericGetCommand(pC_->outString_, AXIS_POSERR_CMD, this->axisNo_);
-    status = pC_->writeReadController();
-    if (updateAxisPositionError(status, pC_->inString_, this->positionError, &final_status)) {
+    if (settle_mode == SETTLE_CONTROLLER) {
+        // Done as soon as the motion status word reads settled, whatever the position error
         getIntegerParam(pC_->motorStatusDone_, &status_done);
         if ((valid_macro_result) && (valid_motion_status) && (valid_ispowered) && (!status_done)) {
             setMotionDone(this->motionStatus, this->macroResult, this->isMotorOn, this->positionError);
         }
     }
 
-    buildGenericGetCommand(pC_->outString_, AXIS_MOTORFAULT_CMD, this->axisNo_);
-    status = pC_->writeReadController();
-    updateAxisMotorFault(status, pC_->inString_, this->motorFault, &final_status);
+    if (mask & POLL_FIELD(POLL_MOTOR_FAULT)) {
+        if (updateAxisMotorFault(status[POLL_MOTOR_FAULT], fields[POLL_MOTOR_FAULT], this->motorFault, &final_status)) {
+            publishField(POLL_MOTOR_FAULT, this->motorFault);
+        }
+    }
+
+    trackHoming(valid_motion_status, valid_macro_result);
+    trackMove(valid_motion_status, valid_ispowered);
 
     getIntegerParam(pC_->motorStatusDone_, &status_done);
     *moving = !status_done;
 
+    if ((this->pollTier == TIER_PARKED) && (this->positionReadback != previous_readback)) {
+        // Moved while parked, by something else than this driver
+        this->pollTier = TIER_IDLE;
+    } else if ((mask & POLL_SETTLE_FIELDS) == POLL_SETTLE_FIELDS) {
+        updatePollTier();
+    }
+
     setStatusProblem(final_status);
 
+    return publishParams();
+}
+
+/** Compares a polled value with the one last published, and records it as published if it changed.
+  *
+  * \param[in] field  Which polled value
+  * \param[in] value  Its new value
+  *
+  * \return true if the value changed (or was never published) and its parameters must be set, false if suppressed
+  */
+bool FlexDCAxis::publishField(flexdcPollField field, long value) {
+    if ((this->publishedMask & POLL_FIELD(field)) && (this->publishedFields[field] == value)) {
+        this->suppressedUpdates++;
+        return false;
+    }
+
+    this->publishedFields[field] = value;
+    this->publishedMask |= POLL_FIELD(field);
+    this->paramsDirty = true;
+    return true;
+}
+
+/** Fires the parameter callbacks of this axis, but only if any of its parameters changed in this poll cycle,
+  * or if they were last fired more than PUBLISH_REFRESH ago (which also refreshes the suppressed updates counter).
+  *
+  * \return Result of callParamCallbacks() call, or asynSuccess if suppressed
+  */
+asynStatus FlexDCAxis::publishParams() {
+    if ((!this->paramsDirty) && (epicsTimeDiffInSeconds(&this->lastPollTime, &this->lastPublishTime) < PUBLISH_REFRESH)) {
+        return asynSuccess;
+    }
+
+    setIntegerParam(pC_->driverSuppressedUpdates, (epicsInt32)this->suppressedUpdates);
+    this->paramsDirty = false;
+    this->lastPublishTime = this->lastPollTime;
+
     return callParamCallbacks();
 }
 
@@ -544,12 +2858,14 @@ asynStatus FlexDCAxis::poll(bool *moving) {
 void FlexDCAxis::setStatusProblem(asynStatus status) {
     int status_problem;
 
-    getIntegerParam(pC_->motorStatus_, &status_problem);
+    getIntegerParam(pC_->motorStatusProblem_, &status_problem);
     if ((status != asynSuccess) && (!status_problem)) {
         setIntegerParam(pC_->motorStatusProblem_, 1);
+        this->paramsDirty = true;
     }
     if ((status == asynSuccess) && (status_problem)) {
         setIntegerParam(pC_->motorStatusProblem_, 0);
+        this->paramsDirty = true;
     }
 }
 
@@ -564,21 +2880,25 @@ void FlexDCAxis::setStatusProblem(asynStatus status) {
   */
 asynStatus FlexDCAxis::setMotionDone(int motion_status, flexdcMacroResult macro_result, bool power_on, long pos_error) {
     asynStatus status = asynSuccess;
-    int allowed_error;
+    int allowed_error, settle_mode = SETTLE_IOC;
     double rdbd=0.0, mres=1.0;
 
     if ((macro_result != EXECUTING) && (motion_status == 0) && (power_on)) {
         getDoubleParam(pC_->driverRetryDeadband, &rdbd);
         getDoubleParam(pC_->driverMotorRecResolution, &mres);
+        getIntegerParam(pC_->driverSettleMode, &settle_mode);
         allowed_error = (int)(rdbd/mres);
 
-        if (labs(pos_error) <= allowed_error) {
+        // In controller settle mode, a null motion status already means within the window
+        if ((settle_mode == SETTLE_CONTROLLER) || (labs(pos_error) <= allowed_error)) {
             log(ASYN_TRACE_FLOW, "FlexDC %s axis %d motion is within error margin, switching off motor\n", pC_->portName, this->axisNo_);
             setIntegerParam(pC_->motorStatusDone_, 1);
+            this->paramsDirty = true;
             status = switchMotorPower(false);
         }
     } else if ((macro_result != EXECUTING) && (motion_status == 0)) {
         setIntegerParam(pC_->motorStatusDone_, 1);
+        this->paramsDirty = true;
     }
 
     return status;
@@ -592,35 +2912,231 @@ asynStatus FlexDCAxis::setMotionDone(int motion_status, flexdcMacroResult macro_
   */
 asynStatus FlexDCAxis::switchMotorPower(bool on) {
     log(ASYN_TRACE_FLOW, "Switching FlexDC %s axis %d power to %d\n", pC_->portName, this->axisNo_, on);
-    buildMotorPowerCommand(pC_->outString_, this->axisNo_, on);
-    return pC_->writeController();
+    buildMotorPowerCommand(pC_->outString_, this->unitAxis, on);
+    return pC_->writeController(this->unit);
 }
 
-/** Stops a motion.
+/** Follows the progress of a homing macro from its fast polls.
+  * Once the macro is over, the axis goes back to the moving tier, so that its next poll is a full one:
+  * the readback is refreshed and the motion is found done as usual.
   *
-  * \return Result of writeController() call
+  * \param[in] valid_motion_status  Whether the motion status was just polled
+  * \param[in] valid_macro_result   Whether the macro result was just polled
+  */
+void FlexDCAxis::trackHoming(bool valid_motion_status, bool valid_macro_result) {
+    if ((this->homeStage == HOME_IDLE) || (this->homeStage >= HOME_DONE) || (!valid_macro_result)) {
+        return;
+    }
+
+    if (this->macroResult == EXECUTING) {
+        if (valid_motion_status) {
+            setHomeStage((this->motionStatus != 0) ? HOME_SEARCHING : HOME_WAITING);
+        }
+    } else {
+        setHomeStage((this->macroResult == OK) ? HOME_DONE : HOME_FAILED);
+        if (this->pollTier == TIER_HOMING) {
+            this->pollTier = TIER_MOVING;
+        }
+    }
+}
+
+void FlexDCAxis::setHomeStage(flexdcHomeStage stage) {
+    if (stage != this->homeStage) {
+        log(ASYN_TRACE_FLOW, "FlexDC %s axis %d homing stage %d\n", pC_->portName, this->axisNo_, stage);
+        this->homeStage = stage;
+        setIntegerParam(pC_->driverHomeStage, stage);
+        this->paramsDirty = true;
+    }
+}
+
+/** Timestamps the state changes of the last move with the time of the poll that saw them,
+  * and accounts for the duration of each phase once over.
+  * Moves over before any poll saw them moving only account for their settle, power-off and total durations.
+  *
+  * \param[in] valid_motion_status  Whether the motion status was just polled
+  * \param[in] valid_ispowered      Whether the motor power was just polled
+  */
+void FlexDCAxis::trackMove(bool valid_motion_status, bool valid_ispowered) {
+    int status_done;
+    bool changed = false;
+
+    if (this->moveState == MOVE_UNTRACKED) {
+        return;
+    }
+    getIntegerParam(pC_->motorStatusDone_, &status_done);
+
+    if ((this->moveState == MOVE_SENT) && (valid_motion_status) && (this->motionStatus != 0)) {
+        addMovePhase(PHASE_START, MOVE_SENT);
+        this->moveTimes[MOVE_MOVING] = this->lastPollTime;
+        this->moveState = MOVE_MOVING;
+        changed = true;
+    }
+    if (((this->moveState == MOVE_SENT) || (this->moveState == MOVE_MOVING)) && (valid_motion_status) && (this->motionStatus == 0)) {
+        if (this->moveState == MOVE_MOVING) {
+            addMovePhase(PHASE_MOTION, MOVE_MOVING);
+            changed = true;
+        }
+        this->moveTimes[MOVE_STOPPED] = this->lastPollTime;
+        this->moveState = MOVE_STOPPED;
+    }
+
+    if ((this->moveState == MOVE_STOPPED) && (status_done)) {
+        addMovePhase(PHASE_SETTLE, MOVE_STOPPED);
+        addMovePhase(PHASE_TOTAL, MOVE_SENT);
+        this->moveTimes[MOVE_SETTLED] = this->lastPollTime;
+        // Already off when done, e.g. after a fault: there is no switching off to time
+        this->moveState = ((valid_ispowered) && (!this->isMotorOn)) ? MOVE_UNTRACKED : MOVE_SETTLED;
+        changed = true;
+    } else if ((this->moveState == MOVE_SETTLED) && (valid_ispowered) && (!this->isMotorOn)) {
+        addMovePhase(PHASE_POWEROFF, MOVE_SETTLED);
+        this->moveState = MOVE_UNTRACKED;
+        changed = true;
+    }
+
+    if (changed) {
+        publishMoveStats();
+    }
+}
+
+/** Accounts for the duration of a move phase, from the time the given state was entered to the last poll.
+  *
+  */
+void FlexDCAxis::addMovePhase(flexdcMovePhase phase, flexdcMoveState from) {
+    double duration = epicsTimeDiffInSeconds(&this->lastPollTime, &this->moveTimes[from]);
+
+    this->moveStats[phase].add((duration > 0.0) ? duration : 0.0);
+}
+
+/** Publishes the minimum, mean, 99th percentile (in ms) and number of the last durations of each move phase.
+  *
+  */
+void FlexDCAxis::publishMoveStats() {
+    double mins[NUM_MOVE_PHASES], means[NUM_MOVE_PHASES], p99s[NUM_MOVE_PHASES], counts[NUM_MOVE_PHASES];
+    int phase;
+
+    for (phase=0; phase<NUM_MOVE_PHASES; phase++) {
+        mins[phase] = this->moveStats[phase].min()*1000.;
+        means[phase] = this->moveStats[phase].mean()*1000.;
+        p99s[phase] = this->moveStats[phase].percentile(0.99)*1000.;
+        counts[phase] = this->moveStats[phase].count;
+    }
+
+    pC_->doCallbacksFloat64Array(mins, NUM_MOVE_PHASES, pC_->driverPhaseMin, this->axisNo_);
+    pC_->doCallbacksFloat64Array(means, NUM_MOVE_PHASES, pC_->driverPhaseMean, this->axisNo_);
+    pC_->doCallbacksFloat64Array(p99s, NUM_MOVE_PHASES, pC_->driverPhaseP99, this->axisNo_);
+    pC_->doCallbacksFloat64Array(counts, NUM_MOVE_PHASES, pC_->driverPhaseCount, this->axisNo_);
+}
+
+/** Programs the in-position window and settle time of the axis into the controller, for controller settle mode,
+  * unless already programmed with the same values.
+  * The window is the retry deadband of the motor record, in counts.
+  *
+  * \return Result of writeController() call, or asynSuccess if already programmed
+  */
+asynStatus FlexDCAxis::programSettleWindow() {
+    asynStatus status;
+    double rdbd=0.0, mres=1.0, settle_time=0.0;
+    int window, time_ms;
+
+    getDoubleParam(pC_->driverRetryDeadband, &rdbd);
+    getDoubleParam(pC_->driverMotorRecResolution, &mres);
+    getDoubleParam(pC_->driverSettleTime, &settle_time);
+    window = (mres != 0.0) ? (int)fabs(rdbd/mres) : 0;
+    time_ms = (settle_time > 0.0) ? (int)settle_time : 0;
+
+    if ((window == this->programmedWindow) && (time_ms == this->programmedSettleTime)) {
+        return asynSuccess;
+    }
+
+    log(ASYN_TRACE_FLOW, "Setting FlexDC %s axis %d settle window to %d counts for %d ms\n", pC_->portName, this->axisNo_, window, time_ms);
+    if (!buildSettleWindowCommand(pC_->outString_, this->unitAxis, window, time_ms)) {
+        return asynError;
+    }
+    status = pC_->writeController(this->unit);
+    if (status == asynSuccess) {
+        this->programmedWindow = window;
+        this->programmedSettleTime = time_ms;
+    }
+    return status;
+}
+
+/** Stops a motion, ahead of any queued poll traffic.
+  *
+  * \param[in] origin  When the stop was requested (can be NULL)
+  *
+  * \return Result of writePriorityController() call
   */
-asynStatus FlexDCAxis::stopMotor() {
+asynStatus FlexDCAxis::stopMotor(const epicsTimeStamp *origin) {
     log(ASYN_TRACE_FLOW, "Stop motion on FlexDC %s axis %d\n", pC_->portName, this->axisNo_);
-    buildStopCommand(pC_->outString_, this->axisNo_);
-    return pC_->writeController();
+    newMotionGeneration();
+    buildStopCommand(pC_->outString_, this->unitAxis);
+    return pC_->writePriorityController(this->unit, origin);
 }
 
-/** Stops a homing macro.
+/** Stops a homing macro, ahead of any queued poll traffic.
   *
-  * \return Result of writeController() call
+  * \param[in] origin  When the stop was requested (can be NULL)
+  *
+  * \return Result of writePriorityController() call
   */
-asynStatus FlexDCAxis::haltHomingMacro() {
+asynStatus FlexDCAxis::haltHomingMacro(const epicsTimeStamp *origin) {
     log(ASYN_TRACE_FLOW, "Halting FlexDC %s axis %d homing macro\n", pC_->portName, this->axisNo_);
-    buildHaltMacroCommand(pC_->outString_, this->axisNo_);
-    return pC_->writeController();
+    buildHaltMacroCommand(pC_->outString_, this->unitAxis);
+    return pC_->writePriorityController(this->unit, origin);
 }
 
-/** Performs a short epicsThreadSleep().
+/** Records that a motion command is about to be sent for the axis.
+  * Polls requested until then are stale: their motion state may predate the command.
+  */
+void FlexDCAxis::newMotionGeneration() {
+    this->motionGeneration++;
+}
+
+/** Waits until the controller reports that both motion and homing macro are stopped.
+  * Motion status and macro result are queried together, with tight retries, for up to the MOTOR_STOP_TIMEOUT record value.
+  * The controller lock is released between retries, and during each query: replies to queries sent before
+  * another motion command are not trusted, and retried.
   *
+  * \return asynSuccess once stopped, asynTimeout if still moving after the timeout, or the exchange error
   */
-void FlexDCAxis::shortWait() {
-    epicsThreadSleep(0.1);
+asynStatus FlexDCAxis::waitMotionStopped() {
+    asynStatus status, field_status[NUM_POLL_FIELDS];
+    char *fields[NUM_POLL_FIELDS];
+    char buffer[MAX_CONTROLLER_STRING_SIZE];
+    epicsTimeStamp start, now;
+    double timeout = 0.0;
+    unsigned int generation;
+    bool valid_motion_status, valid_macro_result;
+
+    getDoubleParam(pC_->driverStopTimeout, &timeout);
+    epicsTimeGetCurrent(&start);
+
+    while (true) {
+        status = asynSuccess;
+        generation = this->motionGeneration;
+        queryPollFieldsBatch(POLL_FIELD(POLL_MOTION_STATUS) | POLL_FIELD(POLL_MACRO_RESULT), field_status, fields, buffer, sizeof(buffer));
+        valid_motion_status = valid_macro_result = false;
+        if (generation == this->motionGeneration) {
+            valid_motion_status = updateAxisMotionStatus(field_status[POLL_MOTION_STATUS], fields[POLL_MOTION_STATUS], this->motionStatus, &status);
+            valid_macro_result = updateAxisMacroResult(field_status[POLL_MACRO_RESULT], fields[POLL_MACRO_RESULT], this->macroResult, &status);
+        }
+
+        if ((valid_motion_status) && (valid_macro_result) && (this->motionStatus == 0) && (this->macroResult != EXECUTING)) {
+            return asynSuccess;
+        }
+
+        epicsTimeGetCurrent(&now);
+        if (epicsTimeDiffInSeconds(&now, &start) >= timeout/1000.) {
+            break;
+        }
+
+        pC_->unlock();
+        epicsThreadSleep(STOP_WAIT_RETRY);
+        pC_->lock();
+    }
+
+    log(ASYN_TRACE_ERROR, "FlexDC %s axis %d did not stop within %g ms\n", pC_->portName, this->axisNo_, timeout);
+    return (status == asynSuccess) ? asynTimeout : status;
 }
 
 /** Shortcuts to asynMotorController functions.
@@ -646,153 +3162,439 @@ void FlexDCAxis::log(int reason, const char *format, ...) {
     }
 }
 
+/** Parses, in a single pass, a decimal integer reply and checks that it fits in [min_value, max_value].
+  * The whole reply must be consumed, apart from trailing white-space.
+  *
+  * \param[in]  reply      The reply string, or one field of a split reply
+  * \param[out] value      The parsed integer, only written on success
+  * \param[in]  min_value  Smallest acceptable value; if not negative, a leading '-' is rejected
+  * \param[in]  max_value  Largest acceptable value
+  *
+  * \return true if reply is a valid integer within range
+  */
+bool FlexDCAxis::parseInteger(const char *reply, long& value, long min_value, long max_value) {
+    bool negative = false;
+    unsigned long magnitude = 0, limit, digit;
+
+    if (!reply) {
+        return false;
+    }
+    if (*reply == '-') {
+        if (min_value >= 0) return false;
+        negative = true;
+        reply++;
+    }
+    if (!isdigit((unsigned char)*reply)) {
+        return false;
+    }
+
+    limit = negative ? 0UL-(unsigned long)min_value : (unsigned long)max_value;
+    if ((!negative) && (max_value < 0)) {
+        return false;
+    }
+    do {
+        digit = (unsigned long)(*reply++ - '0');
+        if ((digit > limit) || (magnitude > (limit-digit)/10)) {
+            return false;
+        }
+        magnitude = magnitude*10 + digit;
+    } while (isdigit((unsigned char)*reply));
+
+    while (isspace((unsigned char)*reply)) reply++;
+    if (*reply) {
+        return false;
+    }
+
+    if (negative) {
+        value = (magnitude == 0) ? 0 : -(long)(magnitude-1)-1;
+        if (value > max_value) return false;
+    } else {
+        value = (long)magnitude;
+        if (value < min_value) return false;
+    }
+    return true;
+}
+
 /** All the following methods parse a reply sent by the controller.
   *
   */
 bool FlexDCAxis::updateAxisReadbackPosition(asynStatus status, const char *reply, long& readback, asynStatus *asyn_error) {
-    bool res = false;
-    if ((status == asynSuccess) && (issigneddigit(reply))) {
-        readback = atol(reply);
-        res = true;
-    } else {
-        if (asyn_error) *asyn_error = asynError;
+    if ((status == asynSuccess) && (parseInteger(reply, readback))) {
+        return true;
     }
-    return res;
+    if (asyn_error) *asyn_error = asynError;
+    return false;
 }
 
 bool FlexDCAxis::updateAxisMotorPower(asynStatus status, const char *reply, bool& motor_power, asynStatus *asyn_error) {
-    bool res = false;
-    if ((status == asynSuccess) && (strlen(reply)==1) && ((*reply>='0') && (*reply<='1'))) {
-        motor_power = atol(reply);
-        res = true;
-    } else {
-        if (asyn_error) *asyn_error = asynError;
+    long value;
+    if ((status == asynSuccess) && (parseInteger(reply, value, 0, 1))) {
+        motor_power = value;
+        return true;
     }
-    return res;
+    if (asyn_error) *asyn_error = asynError;
+    return false;
 }
 
 bool FlexDCAxis::updateAxisMotionStatus(asynStatus status, const char *reply, int& motion_stat, asynStatus *asyn_error) {
-    bool res = false;
-    if ((status == asynSuccess) && (strlen(reply)) && (isdigit(*reply))) {
-        motion_stat = atoi(reply);
-        res = true;
-    } else {
-        if (asyn_error) *asyn_error = asynError;
+    long value;
+    if ((status == asynSuccess) && (parseInteger(reply, value, 0, INT_MAX))) {
+        motion_stat = value;
+        return true;
     }
-    return res;
+    if (asyn_error) *asyn_error = asynError;
+    return false;
 }
 
 bool FlexDCAxis::updateAxisMacroResult(asynStatus status, const char *reply, flexdcMacroResult& macro_res, asynStatus *asyn_error) {
-    bool res = false;
-    if ((status == asynSuccess) && (strlen(reply)==1) && ((*reply>='0') && (*reply<='9'))) {
-        macro_res = static_cast<flexdcMacroResult>(atoi(reply));
-        res = true;
-    } else {
-        if (asyn_error) *asyn_error = asynError;
+    long value;
+    if ((status == asynSuccess) && (parseInteger(reply, value, 0, 9))) {
+        macro_res = static_cast<flexdcMacroResult>(value);
+        return true;
     }
-    return res;
+    if (asyn_error) *asyn_error = asynError;
+    return false;
 }
 
 bool FlexDCAxis::updateAxisMotionEnd(asynStatus status, const char *reply, flexdcMotionEndReason& motion_end, asynStatus *asyn_error) {
-    bool res = false;
-    if ((status == asynSuccess) && (strlen(reply)==1) && ((*reply>='0') && (*reply<='9'))) {
-        motion_end = static_cast<flexdcMotionEndReason>(atoi(reply));
-        res = true;
-    } else {
-        if (asyn_error) *asyn_error = asynError;
+    long value;
+    if ((status == asynSuccess) && (parseInteger(reply, value, 0, 9))) {
+        motion_end = static_cast<flexdcMotionEndReason>(value);
+        return true;
     }
-    return res;
+    if (asyn_error) *asyn_error = asynError;
+    return false;
 }
 
 bool FlexDCAxis::updateAxisPositionError(asynStatus status, const char *reply, long& pos_error, asynStatus *asyn_error) {
-    bool res = false;
-    if ((status == asynSuccess) && (issigneddigit(reply))) {
-        pos_error = atol(reply);
-        res = true;
-    } else {
-        if (asyn_error) *asyn_error = asynError;
+    if ((status == asynSuccess) && (parseInteger(reply, pos_error))) {
+        return true;
     }
-    return res;
+    if (asyn_error) *asyn_error = asynError;
+    return false;
 }
 
 bool FlexDCAxis::updateAxisMotorFault(asynStatus status, const char *reply, int& mot_fault, asynStatus *asyn_error) {
-    bool res = false;
-    if ((status == asynSuccess) && (strlen(reply)) && (isdigit(*reply))) {
-        mot_fault = atoi(reply);
-        res = true;
-    } else {
-        if (asyn_error) *asyn_error = asynError;
+    long value;
+    if ((status == asynSuccess) && (parseInteger(reply, value, 0, INT_MAX))) {
+        mot_fault = value;
+        return true;
     }
-    return res;
+    if (asyn_error) *asyn_error = asynError;
+    return false;
 }
 
 /** All the following methods generate a command string to be sent to the controller.
   *
   */
 bool FlexDCAxis::buildMoveCommand(char *buffer, int axis, double position, bool relative, double velocity) {
-    char mot = CTRL_AXES[axis];
-    if ((!buffer) || (axis<0) || (axis>1)) {
+    if ((!buffer) || (axis<0) || (axis>=CTRL_NUM_AXES)) {
         return false;
     }
+    FlexDCCommandBuffer out(buffer, MAX_CONTROLLER_STRING_SIZE);
     if (relative) {
-        sprintf(buffer, AXIS_MOVEREL_CMD, mot, mot, mot, mot, (int)velocity, mot, (long)position, mot);
+        return FlexDCCommand<CMD_MOVE_REL>::encode(out, CTRL_AXES[axis], (int)velocity, (long)position);
     } else {
-        sprintf(buffer, AXIS_MOVEABS_CMD, mot, mot, mot, mot, (int)velocity, mot, (long)position, mot);
+        return FlexDCCommand<CMD_MOVE_ABS>::encode(out, CTRL_AXES[axis], (int)velocity, (long)position);
     }
-    return true;
+}
+
+bool FlexDCAxis::buildCoordinatedMoveCommand(char *buffer, const flexdcDeferredMove *moves, int num_axes) {
+    bool first = true;
+    int axis, num_pending = 0, last_pending = 0;
+    if ((!buffer) || (!moves) || (num_axes<1) || (num_axes>CTRL_NUM_AXES)) {
+        return false;
+    }
+    FlexDCCommandBuffer out(buffer, MAX_CONTROLLER_STRING_SIZE);
+    for (axis=0; axis<num_axes; axis++) {
+        if (!moves[axis].pending) continue;
+        if (!first) {
+            out.put(CMD_SEPARATOR);
+        }
+        FlexDCCommand<CMD_MOVE_SETUP>::encode(out, CTRL_AXES[axis], moves[axis].relative, moves[axis].velocity, moves[axis].position);
+        first = false;
+        num_pending++;
+        last_pending = axis;
+    }
+    if (!num_pending) {
+        return false;
+    }
+    out.put(CMD_SEPARATOR);
+    return FlexDCCommand<CMD_BEGIN>::encode(out, (num_pending == CTRL_NUM_AXES) ? CTRL_ALL_AXES : CTRL_AXES[last_pending]);
+}
+
+int FlexDCAxis::buildArrayChunkCommand(char *buffer, size_t max_length, int axis, const char *array, int first_index, const double *values, int count, double scale) {
+    char element[64];
+    size_t element_len;
+    int packed = 0;
+    if ((!buffer) || (!array) || (!values) || (axis<0) || (axis>=CTRL_NUM_AXES) || (first_index<1) || (max_length>=MAX_CONTROLLER_STRING_SIZE)) {
+        return 0;
+    }
+    FlexDCCommandBuffer out(buffer, max_length+1);
+    for (; packed<count; packed++) {
+        FlexDCCommandBuffer elem(element, sizeof(element));
+        if (packed) {
+            elem.put(CMD_SEPARATOR);
+        }
+        FlexDCCommand<CMD_ARRAY_SET>::encode(elem, CTRL_AXES[axis], array, first_index+packed, (long)floor(values[packed]*scale+0.5));
+        element_len = strlen(element);
+        if (element_len > out.remaining()) break;
+        out.puts(element);
+    }
+    return packed;
+}
+
+bool FlexDCAxis::buildProfileStartCommand(char *buffer, const bool *used, int num_axes, int num_points) {
+    bool first = true;
+    int axis, num_used = 0, last_used = 0;
+    if ((!buffer) || (!used) || (num_axes<1) || (num_axes>CTRL_NUM_AXES) || (num_points<1)) {
+        return false;
+    }
+    FlexDCCommandBuffer out(buffer, MAX_CONTROLLER_STRING_SIZE);
+    for (axis=0; axis<num_axes; axis++) {
+        if (!used[axis]) continue;
+        if (!first) {
+            out.put(CMD_SEPARATOR);
+        }
+        FlexDCCommand<CMD_PROFILE_START>::encode(out, CTRL_AXES[axis], 1, num_points);
+        first = false;
+        num_used++;
+        last_used = axis;
+    }
+    if (!num_used) {
+        return false;
+    }
+    out.put(CMD_SEPARATOR);
+    return FlexDCCommand<CMD_BEGIN>::encode(out, (num_used == CTRL_NUM_AXES) ? CTRL_ALL_AXES : CTRL_AXES[last_used]);
 }
 
 bool FlexDCAxis::buildSetPositionCommand(char *buffer, int axis, double position) {
-    if ((!buffer) || (axis<0) || (axis>1)) {
+    if ((!buffer) || (axis<0) || (axis>=CTRL_NUM_AXES)) {
         return false;
     }
-    sprintf(buffer, AXIS_FORCEPOS_CMD, CTRL_AXES[axis], (long)position);
-    return true;
+    FlexDCCommandBuffer out(buffer, MAX_CONTROLLER_STRING_SIZE);
+    return FlexDCCommand<CMD_FORCE_POS>::encode(out, CTRL_AXES[axis], (long)position);
 }
 
 bool FlexDCAxis::buildStopCommand(char *buffer, int axis) {
-    if ((!buffer) || (axis<0) || (axis>1)) {
+    if ((!buffer) || (axis<0) || (axis>=CTRL_NUM_AXES)) {
         return false;
     }
-    sprintf(buffer, AXIS_STOP_CMD, CTRL_AXES[axis]);
-    return true;
+    FlexDCCommandBuffer out(buffer, MAX_CONTROLLER_STRING_SIZE);
+    return FlexDCCommand<CMD_STOP>::encode(out, CTRL_AXES[axis]);
 }
 
 bool FlexDCAxis::buildHaltMacroCommand(char *buffer, int axis) {
-    if ((!buffer) || (axis<0) || (axis>1)) {
+    if ((!buffer) || (axis<0) || (axis>=CTRL_NUM_AXES)) {
         return false;
     }
-    //sprintf(buffer, AXIS_MACRO_HALT_CMD, CTRL_AXES[axis]);
-    sprintf(buffer, AXIS_MACRO_KILLINIT_CMD, CTRL_AXES[axis], CTRL_AXES[axis]);
-    return true;
+    FlexDCCommandBuffer out(buffer, MAX_CONTROLLER_STRING_SIZE);
+    return FlexDCCommand<CMD_MACRO_KILLINIT>::encode(out, CTRL_AXES[axis]);
 }
 
 bool FlexDCAxis::buildMotorPowerCommand(char *buffer, int axis, bool on) {
-    if ((!buffer) || (axis<0) || (axis>1)) {
+    if ((!buffer) || (axis<0) || (axis>=CTRL_NUM_AXES)) {
         return false;
     }
-    sprintf(buffer, AXIS_POWER_CMD, CTRL_AXES[axis], on);
-    return true;
+    FlexDCCommandBuffer out(buffer, MAX_CONTROLLER_STRING_SIZE);
+    return FlexDCCommand<CMD_POWER>::encode(out, CTRL_AXES[axis], on);
 }
 
 bool FlexDCAxis::buildHomeMacroCommand(char *buffer, int axis, bool forwards, flexdcHomeMacro home_type) {
-    if ((!buffer) || (axis<0) || (axis>1) || (home_type==DISABLED)) {
+    if ((!buffer) || (axis<0) || (axis>=CTRL_NUM_AXES) || (home_type<=DISABLED) || (home_type>HOME_IDX)) {
         return false;
     }
-    if (forwards) {
-        sprintf(buffer, HOMF_MACRO[home_type], CTRL_AXES[axis], CTRL_AXES[axis]);
-    } else {
-        sprintf(buffer, HOMR_MACRO[home_type], CTRL_AXES[axis], CTRL_AXES[axis]);
+    FlexDCCommandBuffer out(buffer, MAX_CONTROLLER_STRING_SIZE);
+    return FlexDCCommand<CMD_HOME_MACRO>::encode(out, CTRL_AXES[axis], forwards ? HOMF_MACRO[home_type] : HOMR_MACRO[home_type]);
+}
+
+bool FlexDCAxis::buildHomeAllCommand(char *buffer, const flexdcHomeMacro *home_types, int num_axes, bool forwards) {
+    bool first = true;
+    int axis, num_enabled = 0;
+    if ((!buffer) || (!home_types) || (num_axes<1) || (num_axes>CTRL_NUM_AXES)) {
+        return false;
     }
-    return true;
+    for (axis=0; axis<num_axes; axis++) {
+        if ((home_types[axis]>DISABLED) && (home_types[axis]<=HOME_IDX)) num_enabled++;
+    }
+    if (!num_enabled) {
+        return false;
+    }
+    FlexDCCommandBuffer out(buffer, MAX_CONTROLLER_STRING_SIZE);
+    for (axis=0; axis<num_axes; axis++) {
+        if ((home_types[axis]<=DISABLED) || (home_types[axis]>HOME_IDX)) continue;
+        if (!first) {
+            out.put(CMD_SEPARATOR);
+        }
+        FlexDCCommand<CMD_HOME_MACRO>::encode(out, CTRL_AXES[axis], forwards ? HOMF_MACRO[home_types[axis]] : HOMR_MACRO[home_types[axis]]);
+        first = false;
+    }
+    return out.ok();
 }
 
 bool FlexDCAxis::buildGenericGetCommand(char *buffer, const char *command_format, int axis) {
-    if ((!buffer) || (!command_format) || (axis<0) || (axis>1)) {
+    if ((!buffer) || (!command_format) || (axis<0) || (axis>=CTRL_NUM_AXES)) {
         return false;
     }
-    sprintf(buffer, command_format, CTRL_AXES[axis]);
-    return true;
+    if ((strncmp(command_format, "%c", 2)) || (strchr(command_format+2, '%'))) {
+        // Not a plain axis query
+        snprintf(buffer, MAX_CONTROLLER_STRING_SIZE, command_format, CTRL_AXES[axis]);
+        return true;
+    }
+    FlexDCCommandBuffer out(buffer, MAX_CONTROLLER_STRING_SIZE);
+    return encodeAxisQuery(out, CTRL_AXES[axis], command_format);
+}
+
+bool FlexDCAxis::buildPollCommand(char *buffer, int axis, unsigned int fields) {
+    bool first = true;
+    int field;
+    if ((!buffer) || (axis<0) || (axis>=CTRL_NUM_AXES) || (!(fields & POLL_ALL_FIELDS))) {
+        return false;
+    }
+    FlexDCCommandBuffer out(buffer, MAX_CONTROLLER_STRING_SIZE);
+    for (field=0; field<NUM_POLL_FIELDS; field++) {
+        if (!(fields & POLL_FIELD(field))) continue;
+        if (!first) {
+            out.put(CMD_SEPARATOR);
+        }
+        encodeAxisQuery(out, CTRL_AXES[axis], AXIS_POLL_CMDS[field]);
+        first = false;
+    }
+    return out.ok();
+}
+
+bool FlexDCAxis::buildControllerPollCommand(char *buffer, int num_axes, const unsigned int *fields) {
+    bool first = true;
+    int field, axis;
+    if ((!buffer) || (num_axes<1) || (num_axes>CTRL_NUM_AXES)) {
+        return false;
+    }
+    FlexDCCommandBuffer out(buffer, MAX_CONTROLLER_STRING_SIZE);
+    for (field=0; field<NUM_POLL_FIELDS; field++) {
+        for (axis=0; axis<num_axes; axis++) {
+            if ((fields) && (!(fields[axis] & POLL_FIELD(field)))) continue;
+            if (!first) {
+                out.put(CMD_SEPARATOR);
+            }
+            encodeAxisQuery(out, CTRL_AXES[axis], AXIS_POLL_CMDS[field]);
+            first = false;
+        }
+    }
+    return (!first) && (out.ok());
+}
+
+bool FlexDCAxis::buildCaptureCommand(char *buffer, const bool *capture, int num_axes) {
+    bool first = true;
+    int axis;
+    if ((!buffer) || (!capture) || (num_axes<1) || (num_axes>CTRL_NUM_AXES)) {
+        return false;
+    }
+    FlexDCCommandBuffer out(buffer, MAX_CONTROLLER_STRING_SIZE);
+    for (axis=0; axis<num_axes; axis++) {
+        if (!capture[axis]) continue;
+        if (!first) {
+            out.put(CMD_SEPARATOR);
+        }
+        encodeAxisQuery(out, CTRL_AXES[axis], AXIS_GETPOS_CMD);
+        out.put(CMD_SEPARATOR);
+        encodeAxisQuery(out, CTRL_AXES[axis], AXIS_POSERR_CMD);
+        first = false;
+    }
+    return (!first) && (out.ok());
+}
+
+bool FlexDCAxis::buildRecorderArmCommand(char *buffer, int axis, int gap, int length) {
+    if ((!buffer) || (axis<0) || (axis>=CTRL_NUM_AXES) || (gap<1) || (length<1) || (length>FLEXDC_MAX_RECORD_POINTS)) {
+        return false;
+    }
+    FlexDCCommandBuffer out(buffer, MAX_CONTROLLER_STRING_SIZE);
+    return FlexDCCommand<CMD_RECORDER_ARM>::encode(out, CTRL_AXES[axis], gap, length);
+}
+
+bool FlexDCAxis::buildSettleWindowCommand(char *buffer, int axis, int window, int settle_time) {
+    if ((!buffer) || (axis<0) || (axis>=CTRL_NUM_AXES) || (window<0) || (settle_time<0)) {
+        return false;
+    }
+    FlexDCCommandBuffer out(buffer, MAX_CONTROLLER_STRING_SIZE);
+    return FlexDCCommand<CMD_SETTLE_WINDOW>::encode(out, CTRL_AXES[axis], window, settle_time);
+}
+
+bool FlexDCAxis::buildSnapshotTokenCommand(char *buffer, long token) {
+    if (!buffer) {
+        return false;
+    }
+    FlexDCCommandBuffer out(buffer, MAX_CONTROLLER_STRING_SIZE);
+    return FlexDCCommand<CMD_SNAPSHOT_TOKEN>::encode(out, CTRL_AXES[0], token);
+}
+
+bool FlexDCAxis::buildSnapshotCheckCommand(char *buffer, int num_axes) {
+    int axis;
+    if ((!buffer) || (num_axes<1) || (num_axes>CTRL_NUM_AXES)) {
+        return false;
+    }
+    FlexDCCommandBuffer out(buffer, MAX_CONTROLLER_STRING_SIZE);
+    for (axis=0; axis<num_axes; axis++) {
+        encodeAxisQuery(out, CTRL_AXES[axis], AXIS_GETPOS_CMD);
+        out.put(CMD_SEPARATOR);
+    }
+    return encodeAxisQuery(out, CTRL_AXES[0], AXIS_SNAPSHOT_TOKEN_CMD);
+}
+
+int FlexDCAxis::buildArrayQueryCommand(char *buffer, size_t max_length, int axis, const char *array, int first_index, int count) {
+    char element[64];
+    size_t element_len;
+    int packed = 0;
+    if ((!buffer) || (!array) || (axis<0) || (axis>=CTRL_NUM_AXES) || (first_index<1) || (max_length>=MAX_CONTROLLER_STRING_SIZE)) {
+        return 0;
+    }
+    FlexDCCommandBuffer out(buffer, max_length+1);
+    for (; packed<count; packed++) {
+        FlexDCCommandBuffer elem(element, sizeof(element));
+        if (packed) {
+            elem.put(CMD_SEPARATOR);
+        }
+        FlexDCCommand<CMD_ARRAY_GET>::encode(elem, CTRL_AXES[axis], array, first_index+packed);
+        element_len = strlen(element);
+        if (element_len > out.remaining()) break;
+        out.puts(element);
+    }
+    return packed;
+}
+
+/** Splits, in place, a reply to chained commands into its CMD_SEPARATOR-separated fields.
+  * Surrounding white-space is stripped from each field and a trailing separator is ignored.
+  *
+  * \param[in,out] reply       The reply string, which gets modified
+  * \param[out]    fields      Pointers to the start of each field
+  * \param[in]     max_fields  Size of fields
+  *
+  * \return Number of fields found, at most max_fields
+  */
+int FlexDCAxis::splitReply(char *reply, char **fields, int max_fields) {
+    int num_fields = 0;
+    char *last_text;
+
+    if ((!reply) || (!fields)) {
+        return 0;
+    }
+
+    while (num_fields < max_fields) {
+        while (isspace((unsigned char)*reply)) reply++;
+        if (!*reply) break;
+
+        // Walk the field once, remembering where its text last ended
+        fields[num_fields++] = reply;
+        last_text = reply;
+        for (; (*reply) && (*reply != CMD_SEPARATOR); reply++) {
+            if (!isspace((unsigned char)*reply)) last_text = reply+1;
+        }
+        if (*reply) {
+            reply++;
+        }
+        *last_text = '\0';
+    }
+
+    return num_fields;
 }
 
 
@@ -801,32 +3603,42 @@ bool FlexDCAxis::buildGenericGetCommand(char *buffer, const char *command_format
   * Configuration command, called directly or from iocsh.
   *
   * \param[in] portName          The name of the asyn port that will be created for this driver
-  * \param[in] asynPortName      The name of the drvAsynIPPort/drvAsynSerialPortConfigure that was created previously to connect to the Nanomotion controller 
-  * \param[in] numAxes           The number of axes that this controller supports 
+  * \param[in] asynPortName      The name of the drvAsynIPPort/drvAsynSerialPortConfigure that was created previously to connect to the Nanomotion controller,
+  *                              or a comma-separated list of them to drive several units from this port
+  * \param[in] numAxes           The number of axes that this controller supports (ignored, two per unit) 
   * \param[in] movingPollPeriod  The time in ms between polls when any axis is moving
   * \param[in] idlePollPeriod    The time in ms between polls when no axis is moving 
+  * \param[in] snapshotFile      Optional file where the axes state is saved, and restored from at startup
   *
   * \return Always asynSuccess
   */
-extern "C" int NMFlexDCCreateController(const char *portName, const char *asynPortName, int numAxes,  int movingPollPeriod, int idlePollPeriod) {
-    new FlexDCController(portName, asynPortName, numAxes, movingPollPeriod/1000., idlePollPeriod/1000.);
+extern "C" int NMFlexDCCreateController(const char *portName, const char *asynPortName, int numAxes,  int movingPollPeriod, int idlePollPeriod, const char *snapshotFile) {
+    const char *excess = FlexDCController::excessUnits(asynPortName);
+
+    if (excess) {
+        errlogPrintf("FlexDC controller %s not created: more than %d units listed, %s in excess\n", portName, FLEXDC_MAX_UNITS, excess);
+        return asynError;
+    }
+    new FlexDCController(portName, asynPortName, numAxes, movingPollPeriod/1000., idlePollPeriod/1000., snapshotFile);
     return asynSuccess;
 }
 
 /** Code for iocsh registration */
 static const iocshArg NMFlexDCCreateControllerArg0 = { "Port name", iocshArgString };
-static const iocshArg NMFlexDCCreateControllerArg1 = { "Asyn port name", iocshArgString };
+static const iocshArg NMFlexDCCreateControllerArg1 = { "Asyn port name(s)", iocshArgString };
 static const iocshArg NMFlexDCCreateControllerArg2 = { "Number of axes", iocshArgInt };
 static const iocshArg NMFlexDCCreateControllerArg3 = { "Moving poll period (ms)", iocshArgInt };
 static const iocshArg NMFlexDCCreateControllerArg4 = { "Idle poll period (ms)", iocshArgInt };
+static const iocshArg NMFlexDCCreateControllerArg5 = { "Snapshot file (optional)", iocshArgString };
 static const iocshArg * const NMFlexDCCreateControllerArgs[] = { &NMFlexDCCreateControllerArg0,
                                                                  &NMFlexDCCreateControllerArg1,
                                                                  &NMFlexDCCreateControllerArg2,
                                                                  &NMFlexDCCreateControllerArg3,
-                                                                 &NMFlexDCCreateControllerArg4 };
-static const iocshFuncDef NMFlexDCCreateControllerDef = { "NMFlexDCCreateController", 5, NMFlexDCCreateControllerArgs };
+                                                                 &NMFlexDCCreateControllerArg4,
+                                                                 &NMFlexDCCreateControllerArg5 };
+static const iocshFuncDef NMFlexDCCreateControllerDef = { "NMFlexDCCreateController", 6, NMFlexDCCreateControllerArgs };
 static void NMFlexDCCreateControllerCallFunc(const iocshArgBuf *args) {
-    NMFlexDCCreateController(args[0].sval, args[1].sval, args[2].ival, args[3].ival, args[4].ival);
+    NMFlexDCCreateController(args[0].sval, args[1].sval, args[2].ival, args[3].ival, args[4].ival, args[5].sval);
 }
 
 static void NMFlexDCControllerRegister(void) {
@@ -9,9 +9,16 @@ April 2021
 #ifndef _FLEXDCMOTORDRIVER_H_
 #define _FLEXDCMOTORDRIVER_H_
 
+#include <limits.h>
+
 #include <asynMotorController.h>
 #include <asynMotorAxis.h>
 
+#include "FlexDCCommandQueue.h"
+#include "FlexDCCaptureRing.h"
+#include "FlexDCReplyCache.h"
+#include "FlexDCSnapshot.h"
+
 
 
 #define AXIS_MRES_PARAMNAME "MOTOR_MRES"
@@ -19,11 +26,60 @@ April 2021
 #define AXIS_HOMR_PARAMNAME "MOTOR_HOMR"
 #define AXIS_HOMF_PARAMNAME "MOTOR_HOMF"
 #define AXIS_HOMS_PARAMNAME "MOTOR_HOMS"
+#define AXIS_SPOLL_PARAMNAME "MOTOR_SETTLE_POLL"
+#define AXIS_PPOLL_PARAMNAME "MOTOR_PARKED_POLL"
+#define AXIS_HPOLL_PARAMNAME "MOTOR_HOME_POLL"
+#define AXIS_HOMSTG_PARAMNAME "MOTOR_HOME_STAGE"
+#define AXIS_SWIN_PARAMNAME  "MOTOR_SETTLE_WIN"
+#define AXIS_STPTMO_PARAMNAME "MOTOR_STOP_TIMEOUT"
+#define AXIS_SUPP_PARAMNAME "MOTOR_SUPPRESSED_UPDATES"
+#define AXIS_SETTLEMODE_PARAMNAME "MOTOR_SETTLE_MODE"
+#define AXIS_SETTLETIME_PARAMNAME "MOTOR_SETTLE_TIME"
+#define AXIS_PHASEMIN_PARAMNAME   "MOTOR_PHASE_MIN"
+#define AXIS_PHASEMEAN_PARAMNAME  "MOTOR_PHASE_MEAN"
+#define AXIS_PHASEP99_PARAMNAME   "MOTOR_PHASE_P99"
+#define AXIS_PHASECOUNT_PARAMNAME "MOTOR_PHASE_COUNT"
+#define AXIS_CAPT_PARAMNAME     "MOTOR_CAPTURE"
+#define AXIS_CAPTDEC_PARAMNAME  "MOTOR_CAPTURE_DECIMATION"
+#define AXIS_CAPTPOS_PARAMNAME  "MOTOR_CAPTURE_POS"
+#define AXIS_CAPTERR_PARAMNAME  "MOTOR_CAPTURE_ERR"
+#define AXIS_CAPTTIME_PARAMNAME "MOTOR_CAPTURE_TIME"
+#define AXIS_CAPTDROP_PARAMNAME "MOTOR_CAPTURE_DROPPED"
+#define AXIS_RECARM_PARAMNAME  "MOTOR_REC_ARM"
+#define AXIS_RECSTAT_PARAMNAME "MOTOR_REC_STATE"
+#define AXIS_RECLEN_PARAMNAME  "MOTOR_REC_LENGTH"
+#define AXIS_RECGAP_PARAMNAME  "MOTOR_REC_GAP"
+#define AXIS_RECPOS_PARAMNAME  "MOTOR_REC_POS"
+#define AXIS_RECERR_PARAMNAME  "MOTOR_REC_ERR"
+#define AXIS_RECCUR_PARAMNAME  "MOTOR_REC_CURRENT"
+#define AXIS_RECTIME_PARAMNAME "MOTOR_REC_TIME"
 #define CTRL_RST_PARAMNAME  "CTRL_RESET"
+#define CTRL_HOMALL_PARAMNAME "CTRL_HOME_ALL"
+#define CTRL_POLL_PARAMNAME "CTRL_POLL_MODE"
+#define CTRL_STPLAT_PARAMNAME "CTRL_STOP_LATENCY"
+#define CTRL_STPMAX_PARAMNAME "CTRL_STOP_LATENCY_MAX"
+#define CTRL_UPRATE_PARAMNAME "CTRL_UPLOAD_RATE"
+#define CTRL_CAPTPER_PARAMNAME "CTRL_CAPTURE_PERIOD"
+#define CTRL_LATMEAN_PARAMNAME  "CTRL_LATENCY_MEAN"
+#define CTRL_LATMAX_PARAMNAME   "CTRL_LATENCY_MAX"
+#define CTRL_LATCOUNT_PARAMNAME "CTRL_LATENCY_COUNT"
+#define CTRL_CYCLE_PARAMNAME    "CTRL_POLL_CYCLE"
+#define CTRL_CYCLEMAX_PARAMNAME "CTRL_POLL_CYCLE_MAX"
+#define CTRL_OVERRUN_PARAMNAME  "CTRL_POLL_OVERRUNS"
+#define CTRL_STATRST_PARAMNAME  "CTRL_STATS_RESET"
+#define CTRL_LINK_PARAMNAME     "CTRL_LINK"
+#define CTRL_RECONN_PARAMNAME   "CTRL_RECONNECTS"
+
+
+
+// Axis letters of a FlexDC unit: driver axis n is letter CTRL_AXES[n%CTRL_NUM_AXES] of unit n/CTRL_NUM_AXES
+const char CTRL_AXES[] = { 'X', 'Y' };
+const int CTRL_NUM_AXES = sizeof(CTRL_AXES);
 
+const char CTRL_ALL_AXES = 'A';
 
-
-const char CTRL_AXES[] = { 'X', 'Y' };
+const char CTRL_UNIT_SEPARATOR = ',';
+#define FLEXDC_MAX_UNITS 16
 
 const char CTRL_VER_CMD[] = "XVR";
 
@@ -50,9 +106,71 @@ const char AXIS_ISPOWERED_CMD[] = "%cMO";
 
 const char AXIS_MACRO_RESULT_CMD[] = "%cPA[11]";
 
+// Controller-side settling: in-position window (counts) in TR[1] and settle time (ms) in TR[2],
+// after which the motion status only reads 0 once the axis has stayed that long within the window
+const char AXIS_SETTLE_WINDOW_CMD[] = "%cTR[1]=%d;%cTR[2]=%d";
+const double DEFAULT_SETTLE_TIME = 10.0;   // ms
+
+// Snapshot token: written by each IOC run into PA[90] of the first axis of each unit, a variable assumed unused by the macros,
+// and cleared by a controller reset or power cycle
+const char AXIS_SNAPSHOT_TOKEN_CMD[]    = "%cPA[90]";
+const char AXIS_SETSNAPSHOT_TOKEN_CMD[] = "%cPA[90]=%ld";
+
 const char AXIS_MACRO_HALT_CMD[]     = "%cQH";
 const char AXIS_MACRO_KILLINIT_CMD[] = "%cQK;%cQI";
 
+// Profile moves use the PT (position-time) interpolated motion mode: positions in QP[], times (ms) in QT[], both 1-based
+const char AXIS_PROFILE_POS_ARRAY[]  = "QP";
+const char AXIS_PROFILE_TIME_ARRAY[] = "QT";
+#define FLEXDC_MAX_PROFILE_POINTS 1024
+const size_t CTRL_MAX_LINE_LENGTH = MAX_CONTROLLER_STRING_SIZE-1; // Longest command line accepted by the controller, without EOS
+const double PROFILE_END_TIMEOUT = 5.0;   // s, after the last point time
+
+// Position capture: samples of PS and PE taken by the sampler thread, published as rolling waveforms
+#define FLEXDC_CAPTURE_POINTS 2048
+const double DEFAULT_CAPTURE_PERIOD = 5.0; // ms
+const double MIN_CAPTURE_PERIOD = 1.0;     // ms
+const double CAPTURE_IDLE_WAIT = 1.0;      // s, sampler wake-up period while no axis captures
+
+// On-board recorder: records every gap servo samples (of TS us) position, position error and motor current into the 1-based RV1[], RV2[], RV3[] arrays,
+// starting on the next begin once armed; RR reads back 0 once done
+const char AXIS_REC_ARM_CMD[]      = "%cRR=0;%cRC=7;%cRG=%d;%cRL=%d;%cRR=2";
+const char AXIS_REC_STATUS_CMD[]   = "%cRR";
+const char AXIS_SAMPLE_TIME_CMD[]  = "%cTS";
+const char* const AXIS_REC_ARRAYS[] = { "RV1", "RV2", "RV3" };
+#define FLEXDC_MAX_RECORD_POINTS 4096
+const int CTRL_MAX_REPLY_VALUES = MAX_CONTROLLER_STRING_SIZE/12; // Values per reply line, each up to 11 characters and a separator
+
+const char CMD_SEPARATOR = ';';
+
+const double DEFAULT_STOP_TIMEOUT = 500.0; // ms
+const double STOP_WAIT_RETRY = 0.005;      // s
+const double PUBLISH_REFRESH = 1.0;        // s, callbacks are fired at least this often even if nothing changed
+// State snapshot: saved at most this often, and only if changed; restored at startup if the controller still holds the token
+// of the IOC run that saved it, and still reads the saved positions
+const double SNAPSHOT_PERIOD = 1.0;        // s
+const long SNAPSHOT_POSITION_TOLERANCE = 10; // counts
+const double REPLY_CACHE_MAX_AGE = 60.0;   // s, cached replies are re-read at least this often, in case of changes behind the driver
+
+// Connection supervision: a unit is down once its connection is lost, or after this many failed transfers in a row
+// (a pipelined batch of exchanges failing together counts once);
+// it is then reconnected with an exponential backoff, and fully re-read in one batch before normal polling resumes
+const int LINK_FAILURE_THRESHOLD = 3;
+const double LINK_CHECK_PERIOD = 0.2;      // s
+const double LINK_RETRY_MIN = 0.1;         // s
+const double LINK_RETRY_MAX = 5.0;         // s
+
+// Status queries issued on every poll, in the order of flexdcPollField
+const char* const AXIS_POLL_CMDS[] = {
+    AXIS_GETPOS_CMD,
+    AXIS_ISPOWERED_CMD,
+    AXIS_MOTIONSTATUS_CMD,
+    AXIS_MACRO_RESULT_CMD,
+    AXIS_MOTIONEND_CMD,
+    AXIS_POSERR_CMD,
+    AXIS_MOTORFAULT_CMD
+};
+
 
 
 enum flexdcMotionEndReason {
@@ -82,6 +200,102 @@ enum flexdcHomeMacro {
     HOME_IDX
 };
 
+// Progress of a homing macro, as seen by the fast homing poll
+enum flexdcHomeStage {
+    HOME_IDLE,
+    HOME_STARTED,    // Macro sent, not yet reported executing
+    HOME_SEARCHING,  // Macro executing, axis moving
+    HOME_WAITING,    // Macro executing, axis stopped
+    HOME_DONE,
+    HOME_FAILED
+};
+
+struct flexdcDeferredMove {
+    bool pending;
+    bool relative;
+    long position;
+    int velocity;
+};
+
+enum flexdcPollField {
+    POLL_READBACK,
+    POLL_POWER,
+    POLL_MOTION_STATUS,
+    POLL_MACRO_RESULT,
+    POLL_MOTION_END,
+    POLL_POSITION_ERROR,
+    POLL_MOTOR_FAULT,
+    NUM_POLL_FIELDS
+};
+
+#define POLL_FIELD(field)  (1u << (field))
+#define POLL_ALL_FIELDS    (POLL_FIELD(NUM_POLL_FIELDS)-1)
+#define POLL_PARKED_FIELDS (POLL_FIELD(POLL_READBACK) | POLL_FIELD(POLL_MOTOR_FAULT))
+#define POLL_SETTLE_FIELDS (POLL_FIELD(POLL_READBACK) | POLL_FIELD(POLL_POWER) | POLL_FIELD(POLL_MOTION_STATUS) | POLL_FIELD(POLL_MACRO_RESULT))
+#define POLL_HOME_FIELDS   (POLL_FIELD(POLL_MOTION_STATUS) | POLL_FIELD(POLL_MACRO_RESULT))
+#define POLL_MOTION_FIELDS (POLL_FIELD(POLL_POWER) | POLL_FIELD(POLL_MOTION_STATUS) | POLL_FIELD(POLL_MACRO_RESULT) | POLL_FIELD(POLL_POSITION_ERROR))
+
+enum flexdcRecordSignal {
+    REC_POSITION,
+    REC_POSITION_ERROR,
+    REC_CURRENT,
+    NUM_REC_SIGNALS
+};
+
+enum flexdcRecorderState {
+    REC_IDLE,
+    REC_ARMED,
+    REC_READING,
+    REC_DONE,
+    REC_FAILED
+};
+
+enum flexdcPollMode {
+    POLL_SEQUENTIAL,
+    POLL_AXIS_BATCH,
+    POLL_CONTROLLER_BATCH
+};
+
+enum flexdcSettleMode {
+    SETTLE_IOC,
+    SETTLE_CONTROLLER
+};
+
+// Tracking of a move, from its command being sent to its motor being switched off
+enum flexdcMoveState {
+    MOVE_UNTRACKED,
+    MOVE_SENT,
+    MOVE_MOVING,
+    MOVE_STOPPED,
+    MOVE_SETTLED
+};
+
+// Durations measured for each move, between the polls that saw each state change
+enum flexdcMovePhase {
+    PHASE_START,     // Command sent to motion status non-zero
+    PHASE_MOTION,    // Motion status non-zero to zero
+    PHASE_SETTLE,    // Motion status zero to done (within deadband)
+    PHASE_POWEROFF,  // Done to motor off
+    PHASE_TOTAL,     // Command sent to done
+    NUM_MOVE_PHASES
+};
+
+const char* const MOVE_PHASE_NAMES[] = {
+    "start",
+    "motion",
+    "settle",
+    "poweroff",
+    "total"
+};
+
+enum flexdcPollTier {
+    TIER_PARKED,
+    TIER_IDLE,
+    TIER_MOVING,
+    TIER_SETTLING,
+    TIER_HOMING
+};
+
 
 
 class FlexDCAxis: public asynMotorAxis {
@@ -99,6 +313,8 @@ public:
 
     asynStatus poll(bool *moving);
 
+    asynStatus initializeProfile(size_t maxPoints);
+
     // Class-wide methods
     static bool updateAxisReadbackPosition(asynStatus status, const char *reply, long& readback, asynStatus *asyn_error);
     static bool updateAxisMotorPower(asynStatus status, const char *reply, bool& motor_power, asynStatus *asyn_error);
@@ -109,30 +325,72 @@ public:
     static bool updateAxisMotorFault(asynStatus status, const char *reply, int& mot_fault, asynStatus *asyn_error);
 
     static bool buildMoveCommand(char *buffer, int axis, double position, bool relative, double velocity);
+    static bool buildCoordinatedMoveCommand(char *buffer, const flexdcDeferredMove *moves, int num_axes);
+    static int buildArrayChunkCommand(char *buffer, size_t max_length, int axis, const char *array, int first_index, const double *values, int count, double scale=1.0);
+    static bool buildProfileStartCommand(char *buffer, const bool *used, int num_axes, int num_points);
     static bool buildSetPositionCommand(char *buffer, int axis, double position);
     static bool buildStopCommand(char *buffer, int axis);
     static bool buildHaltMacroCommand(char *buffer, int axis);
     static bool buildMotorPowerCommand(char *buffer, int axis, bool on);
     static bool buildHomeMacroCommand(char *buffer, int axis, bool forwards, flexdcHomeMacro home_type);
+    static bool buildHomeAllCommand(char *buffer, const flexdcHomeMacro *home_types, int num_axes, bool forwards);
     static bool buildGenericGetCommand(char *buffer, const char *command_format, int axis);
+    static bool buildPollCommand(char *buffer, int axis, unsigned int fields=POLL_ALL_FIELDS);
+    static bool buildControllerPollCommand(char *buffer, int num_axes, const unsigned int *fields=NULL);
+    static bool buildCaptureCommand(char *buffer, const bool *capture, int num_axes);
+    static bool buildRecorderArmCommand(char *buffer, int axis, int gap, int length);
+    static bool buildSettleWindowCommand(char *buffer, int axis, int window, int settle_time);
+    static bool buildSnapshotTokenCommand(char *buffer, long token);
+    static bool buildSnapshotCheckCommand(char *buffer, int num_axes);
+    static int buildArrayQueryCommand(char *buffer, size_t max_length, int axis, const char *array, int first_index, int count);
+
+    static int splitReply(char *reply, char **fields, int max_fields);
+
+    static bool parseInteger(const char *reply, long& value, long min_value=LONG_MIN, long max_value=LONG_MAX);
 
     static bool issigneddigit(const char *buffer) {
-        size_t buf_len = strlen(buffer);
-        if (buf_len == 1) return isdigit(*buffer);
-        if (buf_len > 1) return isdigit(*buffer) || (*buffer=='-' && isdigit(*++buffer));
-        return false;
+        return (buffer) && ((isdigit(*buffer)) || ((*buffer=='-') && (isdigit(buffer[1]))));
     }
 
 protected:
     // Specific class methods
+    virtual asynStatus pollAxis(bool *moving);
     virtual void setStatusProblem(asynStatus status);
 
+    virtual unsigned int selectPollFields();
+    virtual void updatePollTier();
+
+    virtual void queryPollFields(unsigned int mask, asynStatus *status, char **fields, char *buffer, size_t buffer_size);
+    virtual void queryPollFieldsBatch(unsigned int mask, asynStatus *status, char **fields, char *buffer, size_t buffer_size);
+    virtual asynStatus updatePollFields(unsigned int mask, const asynStatus *status, char * const *fields, bool *moving);
+    virtual bool publishField(flexdcPollField field, long value);
+    virtual asynStatus publishParams();
+
+    virtual void startCapture();
+    virtual void drainCapture();
+
+    virtual asynStatus armRecorder();
+    virtual asynStatus armProfileRecorder(double duration);
+    virtual asynStatus startRecorder(int gap, int length);
+    virtual void updateRecorder();
+    virtual asynStatus readRecorder();
+    virtual void setRecorderState(flexdcRecorderState state);
+
     virtual asynStatus setMotionDone(int motion_status, flexdcMacroResult macro_result, bool power_on, long pos_error);
 
     virtual asynStatus switchMotorPower(bool on);
-    virtual asynStatus stopMotor();
-    virtual asynStatus haltHomingMacro();
-    virtual void shortWait();
+    virtual asynStatus stopMotor(const epicsTimeStamp *origin=NULL);
+    virtual asynStatus haltHomingMacro(const epicsTimeStamp *origin=NULL);
+    virtual asynStatus waitMotionStopped();
+    virtual void newMotionGeneration();
+    virtual asynStatus programSettleWindow();
+
+    virtual void trackHoming(bool valid_motion_status, bool valid_macro_result);
+    virtual void setHomeStage(flexdcHomeStage stage);
+
+    virtual void trackMove(bool valid_motion_status, bool valid_ispowered);
+    virtual void addMovePhase(flexdcMovePhase phase, flexdcMoveState from);
+    virtual void publishMoveStats();
 
     virtual asynStatus getIntegerParam(int index, epicsInt32 *value);
     virtual asynStatus getDoubleParam(int index, double *value);
@@ -142,6 +400,9 @@ protected:
     FlexDCController *pC_; // Pointer to the asynMotorController to which this axis belongs
 
 private:
+    int unit;
+    int unitAxis;
+
     int motionStatus;
     int motorFault;
     flexdcMotionEndReason endMotionReason;
@@ -150,25 +411,138 @@ private:
     long positionReadback;
     bool isMotorOn;
 
+    long targetPosition;
+    flexdcDeferredMove deferredMove;
+
+    int programmedWindow;
+    int programmedSettleTime;
+
+    flexdcHomeStage homeStage;
+
+    flexdcMoveState moveState;
+    epicsTimeStamp moveTimes[MOVE_SETTLED+1];
+    FlexDCRollingStats moveStats[NUM_MOVE_PHASES];
+
+    double *profileCapturePositions;
+    double *profileCaptureErrors;
+    bool profileRecording;
+    int profileRecordedPoints;
+
+    FlexDCCaptureRing *captureRing;
+    bool captureEnabled;
+    int captureSkipped;
+    int capturePoints;
+    double *captureTimes;
+    double *capturePositions;
+    double *captureErrors;
+    epicsTimeStamp captureStartTime;
+    size_t publishedDropped;
+
+    flexdcRecorderState recorderState;
+    int recordPoints;
+    int recordLength;
+    int recordGap;
+    double *recordTimes;
+    double *recordSignals[NUM_REC_SIGNALS];
+
+    flexdcPollTier pollTier;
+    epicsTimeStamp lastPollTime;
+
+    unsigned int motionGeneration;
+    unsigned int pollGeneration;
+
+    bool polledValid;
+    unsigned int polledMask;
+    asynStatus polledStatus[NUM_POLL_FIELDS];
+    char *polledFields[NUM_POLL_FIELDS];
+
+    long publishedFields[NUM_POLL_FIELDS];
+    unsigned int publishedMask;
+    bool paramsDirty;
+    epicsUInt32 suppressedUpdates;
+    epicsTimeStamp lastPublishTime;
+
 friend class FlexDCController;
 };
 
 
 
+/** One FlexDC unit behind a driver port, with its own connection and I/O thread.
+  *
+  */
+struct FlexDCUnit {
+    char asynPortName[64];
+    asynUser *pasynUser;
+    asynUser *pasynUserCommon;
+    FlexDCCommandQueue *commandQueue;
+    FlexDCRequest *pollRequest;
+    char pollReply[MAX_CONTROLLER_STRING_SIZE];
+    double publishedStopLatency;
+    double publishedStopLatencyMax;
+    FlexDCReplyCache replyCache;
+    bool linkDown;
+    bool resyncPending;
+    epicsUInt32 reconnects;
+};
+
+
+
 class FlexDCController: public asynMotorController {
 
 public:
-    FlexDCController(const char *portName, const char *asynPortName, int numAxes, double movingPollPeriod, double idlePollPeriod);
+    FlexDCController(const char *portName, const char *asynPortName, int numAxes, double movingPollPeriod, double idlePollPeriod, const char *snapshotFile=NULL);
 
     // These are the methods we override from the base class
     asynStatus writeInt32(asynUser *pasynUser, epicsInt32 value);
+    asynStatus setDeferredMoves(bool deferMoves);
+
+    asynStatus initializeProfile(size_t maxPoints);
+    asynStatus buildProfile();
+    asynStatus executeProfile();
+    asynStatus abortProfile();
+    asynStatus readbackProfile();
+
+    asynStatus poll();
+
+    asynStatus writeController();
+    asynStatus writeReadController();
+    asynStatus writeController(int unit);
+    asynStatus writeReadController(int unit);
+    asynStatus writeReadControllerCached(int unit, double max_age=REPLY_CACHE_MAX_AGE);
+    asynStatus writePriorityController(int unit, const epicsTimeStamp *origin=NULL);
+
+    static int countUnits(const char *asynPortNames);
+    static const char *excessUnits(const char *asynPortNames);
+    static int checkSnapshot(char *reply, const FlexDCAxisSnapshot *saved, int num_axes, long token, long *positions, bool *restore);
 
     void report(FILE *fp, int level);
 
+    void captureThread();
+    void linkThread();
+    void recorderThread();
+
     FlexDCAxis* getAxis(asynUser *pasynUser);
     FlexDCAxis* getAxis(int axisNo);
 
 protected:
+    virtual void setupEos(asynUser *pasynUser);
+    virtual asynStatus startDeferredMoves();
+    virtual asynStatus homeAllAxes(bool forwards);
+    virtual void updateProfileExecution();
+    virtual asynStatus uploadArray(int unit, int unit_axis, const char *array, const double *values, int count, double scale, int *num_commands);
+    virtual void setProfileState(int state_param, int state, int status_param, int status, int message_param, const char *message);
+    virtual void sampleUnits(const bool *capture);
+    virtual asynStatus downloadArray(int unit, int unit_axis, const char *array, double *values, int count);
+    virtual void endPollCycle();
+    virtual void publishStatistics();
+    virtual void resetStatistics();
+    virtual bool checkLink(int unit);
+    virtual asynStatus reconnectUnit(int unit);
+    virtual void setLinkState(int unit, bool up);
+    virtual void restoreSnapshot();
+    virtual void saveSnapshot();
+    virtual void writeSnapshot();
+
     virtual void log(int reason, const char *format, ...);
 
     int driverMotorRecResolution;
@@ -177,9 +551,85 @@ protected:
     int driverHomeForwardMacro;
     int driverHomeStatus;
     int driverResetController;
-#define NUM_FLEXDC_PARAMS 6
+    int driverHomeAll;
+    int driverPollMode;
+    int driverStopLatency;
+    int driverStopLatencyMax;
+    int driverSettlePollPeriod;
+    int driverParkedPollPeriod;
+    int driverHomePollPeriod;
+    int driverHomeStage;
+    int driverSettleWindow;
+    int driverStopTimeout;
+    int driverSuppressedUpdates;
+    int driverSettleMode;
+    int driverSettleTime;
+    int driverPhaseMin;
+    int driverPhaseMean;
+    int driverPhaseP99;
+    int driverPhaseCount;
+    int driverUploadRate;
+    int driverCapture;
+    int driverCaptureDecimation;
+    int driverCapturePositions;
+    int driverCaptureErrors;
+    int driverCaptureTimes;
+    int driverCaptureDropped;
+    int driverCapturePeriod;
+    int driverRecorderArm;
+    int driverRecorderState;
+    int driverRecorderLength;
+    int driverRecorderGap;
+    int driverRecordPositions;
+    int driverRecordErrors;
+    int driverRecordCurrents;
+    int driverRecordTimes;
+    int driverLatencyMean;
+    int driverLatencyMax;
+    int driverLatencyCount;
+    int driverPollCycle;
+    int driverPollCycleMax;
+    int driverPollOverruns;
+    int driverStatsReset;
+    int driverLinkUp;
+    int driverReconnects;
+#define NUM_FLEXDC_PARAMS 48
+
+    FlexDCUnit *units;
+    int numUnits;
+
+    bool movesDeferred;
+
+    double *profilePointTimes;
+    int profileCapturedPoints;
+    bool profileExecuting;
+    epicsTimeStamp profileStartTime;
+
+    epicsEventId captureEvent;
+    epicsEventId linkEvent;
+
+    epicsTimeStamp pollCycleStart;
+    bool pollCycleMoving;
+    FlexDCLatencyHistogram pollCycleStats;
+    double lastPollCycle;
+    epicsUInt32 pollOverruns;
+    epicsTimeStamp lastStatsPublishTime;
+
+    double baseMovingPollPeriod;
+
+    char snapshotPath[256];
+    FlexDCAxisSnapshot snapshotAxes[FLEXDC_MAX_UNITS*CTRL_NUM_AXES];
+    FlexDCAxisSnapshot pendingSnapshot[FLEXDC_MAX_UNITS*CTRL_NUM_AXES];
+    bool snapshotQueued;
+    long snapshotToken;
+    epicsTimeStamp lastSnapshotTime;
+    bool snapshotFailed;
+
+    flexdcPollMode pollMode;
 
 private:
+    char **pollFields;
+    unsigned int *pollMasks;
 
 friend class FlexDCAxis;
 };
@@ -0,0 +1,168 @@
+/*
+FILENAME...   FlexDCReplyCache.h
+USAGE...      Cache of the replies to slow-changing queries of the Nanomotion FlexDC controller
+
+Jose G.C. Gabadinho
+April 2021
+*/
+
+#ifndef _FLEXDCREPLYCACHE_H_
+#define _FLEXDCREPLYCACHE_H_
+
+#include <stdio.h>
+#include <string.h>
+
+#include <asynMotorController.h>
+
+#include <epicsTime.h>
+#include <epicsTypes.h>
+
+
+
+#define FLEXDC_REPLY_CACHE_SIZE 16
+#define FLEXDC_CACHE_KEY_SIZE   16
+
+
+
+struct FlexDCCacheEntry {
+    char command[FLEXDC_CACHE_KEY_SIZE];
+    char reply[MAX_CONTROLLER_STRING_SIZE];
+    epicsTimeStamp time;
+    bool valid;
+};
+
+
+
+/** Replies to queries of one unit, by query command (e.g. XVR, YSP), until invalidated by a write or too old.
+  * Not thread-safe: used with the controller lock held.
+  */
+class FlexDCReplyCache {
+
+public:
+    FlexDCReplyCache(): hits(0), misses(0) {
+        clear();
+    }
+
+    void clear() {
+        int entry;
+
+        for (entry=0; entry<FLEXDC_REPLY_CACHE_SIZE; entry++) {
+            this->entries[entry].valid = false;
+        }
+    }
+
+    /** Retrieves the cached reply to a query.
+      *
+      * \param[in]  command     The query
+      * \param[out] reply       Its reply
+      * \param[in]  reply_size  Size of reply
+      * \param[in]  max_age     Oldest acceptable reply, in seconds
+      *
+      * \return false if not cached, or too old
+      */
+    bool lookup(const char *command, char *reply, size_t reply_size, double max_age) {
+        FlexDCCacheEntry *p_entry = find(command, strlen(command));
+        epicsTimeStamp now;
+
+        epicsTimeGetCurrent(&now);
+        if ((!p_entry) || (epicsTimeDiffInSeconds(&now, &p_entry->time) > max_age)) {
+            this->misses++;
+            return false;
+        }
+
+        snprintf(reply, reply_size, "%s", p_entry->reply);
+        this->hits++;
+        return true;
+    }
+
+    /** Caches the reply to a query, replacing the oldest entry if full.
+      * Queries too long to be a key are not cached.
+      *
+      */
+    void store(const char *command, const char *reply) {
+        FlexDCCacheEntry *p_entry;
+        size_t len = strlen(command);
+        int entry;
+
+        if (len >= FLEXDC_CACHE_KEY_SIZE) {
+            return;
+        }
+
+        p_entry = find(command, len);
+        for (entry=0; (!p_entry) && (entry<FLEXDC_REPLY_CACHE_SIZE); entry++) {
+            if (!this->entries[entry].valid) p_entry = &this->entries[entry];
+        }
+        if (!p_entry) {
+            p_entry = &this->entries[0];
+            for (entry=1; entry<FLEXDC_REPLY_CACHE_SIZE; entry++) {
+                if (epicsTimeDiffInSeconds(&this->entries[entry].time, &p_entry->time) < 0.0) p_entry = &this->entries[entry];
+            }
+        }
+
+        memcpy(p_entry->command, command, len+1);
+        snprintf(p_entry->reply, sizeof(p_entry->reply), "%s", reply);
+        epicsTimeGetCurrent(&p_entry->time);
+        p_entry->valid = true;
+    }
+
+    /** Drops the cached replies made stale by a command line about to be sent:
+      * each assignment (e.g. XSP=1000) drops the reply to the matching query (XSP),
+      * and a controller reset (RS) drops everything.
+      *
+      */
+    void invalidate(const char *command) {
+        FlexDCCacheEntry *p_entry;
+        const char *end, *assignment;
+
+        while (*command) {
+            end = strchr(command, ';');
+            if (!end) end = command+strlen(command);
+
+            if ((end-command == 3) && (!strncmp(command+1, "RS", 2))) {
+                clear();
+                return;
+            }
+            assignment = (const char *)memchr(command, '=', end-command);
+            if ((assignment) && ((p_entry = find(command, assignment-command)))) {
+                p_entry->valid = false;
+            }
+            if ((assignment) && (command[0] == 'A')) {
+                // Assignments to all axes drop the reply of each axis
+                invalidateAllAxes(command+1, assignment-command-1);
+            }
+
+            command = *end ? end+1 : end;
+        }
+    }
+
+    epicsUInt32 hits;
+    epicsUInt32 misses;
+
+private:
+    FlexDCCacheEntry* find(const char *command, size_t len) {
+        int entry;
+
+        for (entry=0; entry<FLEXDC_REPLY_CACHE_SIZE; entry++) {
+            if ((this->entries[entry].valid) && (strlen(this->entries[entry].command) == len) &&
+                (!strncmp(this->entries[entry].command, command, len))) {
+                return &this->entries[entry];
+            }
+        }
+        return NULL;
+    }
+
+    void invalidateAllAxes(const char *query, size_t len) {
+        int entry;
+
+        for (entry=0; entry<FLEXDC_REPLY_CACHE_SIZE; entry++) {
+            if ((this->entries[entry].valid) && (strlen(this->entries[entry].command) == len+1) &&
+                (!strncmp(this->entries[entry].command+1, query, len))) {
+                this->entries[entry].valid = false;
+            }
+        }
+    }
+
+    FlexDCCacheEntry entries[FLEXDC_REPLY_CACHE_SIZE];
+};
+
+#endif // _FLEXDCREPLYCACHE_H_
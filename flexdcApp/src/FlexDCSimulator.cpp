@@ -0,0 +1,608 @@
+/*
+FILENAME...   FlexDCSimulator.cpp
+USAGE...      In-process TCP simulator of the Nanomotion FlexDC controller, for tests without hardware
+
+Jose G.C. Gabadinho
+April 2021
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <stdarg.h>
+#include <ctype.h>
+
+#include "FlexDCSimulator.h"
+
+#include <iocsh.h>
+#include <errlog.h>
+#include <epicsThread.h>
+
+#include <epicsExport.h>
+
+
+
+struct FlexDCSimConnection {
+    FlexDCSimulator *simulator;
+    SOCKET sock;
+};
+
+FlexDCSimulator *FlexDCSimulator::simulators = NULL;
+
+static void listenThreadC(void *pPvt) {
+    FlexDCSimulator *p_simulator = static_cast<FlexDCSimulator*>(pPvt);
+    p_simulator->listenThread();
+}
+
+static void connectionThreadC(void *pPvt) {
+    FlexDCSimConnection *p_connection = static_cast<FlexDCSimConnection*>(pPvt);
+    p_connection->simulator->connectionThread(p_connection->sock);
+    delete p_connection;
+}
+
+/** Creates a new FlexDCSimulator object, with all axes switched off at position 0.
+  * Nothing is listened to until start() is called.
+  *
+  * \param[in] tcpPort  The loopback TCP port to listen to
+  * \param[in] latency  Default delay, in seconds, before replying to each command of a line
+  */
+FlexDCSimulator::FlexDCSimulator(int tcpPort, double latency): tcpPort(tcpPort), listenSocket(INVALID_SOCKET) {
+    this->mutex = epicsMutexMustCreate();
+    this->defaultLatency = latency;
+    this->numLatencies = 0;
+    this->dropPercent = 0;
+    this->errorPercent = 0;
+
+    resetAxes();
+
+    this->next = simulators;
+    simulators = this;
+}
+
+/** Starts listening to the loopback TCP port, each accepted connection being served by its own thread.
+  *
+  * \return asynSuccess if listening, asynError otherwise
+  */
+asynStatus FlexDCSimulator::start() {
+    osiSockAddr addr;
+    char thread_name[32];
+
+    osiSockAttach();
+    this->listenSocket = epicsSocketCreate(AF_INET, SOCK_STREAM, 0);
+    if (this->listenSocket == INVALID_SOCKET) {
+        log("Cannot create FlexDC simulator socket\n");
+        return asynError;
+    }
+    epicsSocketEnableAddressReuseDuringTimeWaitState(this->listenSocket);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.ia.sin_family = AF_INET;
+    addr.ia.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.ia.sin_port = htons((unsigned short)this->tcpPort);
+    if ((bind(this->listenSocket, &addr.sa, sizeof(addr.ia))) || (listen(this->listenSocket, 4))) {
+        log("Cannot listen to FlexDC simulator port %d\n", this->tcpPort);
+        epicsSocketDestroy(this->listenSocket);
+        this->listenSocket = INVALID_SOCKET;
+        return asynError;
+    }
+
+    snprintf(thread_name, sizeof(thread_name), "FlexDCSim_%d", this->tcpPort);
+    epicsThreadCreate(thread_name, epicsThreadPriorityMedium, epicsThreadGetStackSize(epicsThreadStackMedium), listenThreadC, this);
+
+    return asynSuccess;
+}
+
+/** Sets the delay before replying to a given command.
+  *
+  * \param[in] mnemonic  The two-letter command, without axis letter (e.g. PS, BG)
+  * \param[in] latency   Delay, in seconds
+  */
+void FlexDCSimulator::setLatency(const char *mnemonic, double latency) {
+    int entry;
+
+    epicsMutexMustLock(this->mutex);
+    for (entry=0; entry<this->numLatencies; entry++) {
+        if (!strcmp(this->latencyMnemonics[entry], mnemonic)) break;
+    }
+    if (entry < FLEXDC_SIM_MAX_LATENCIES) {
+        snprintf(this->latencyMnemonics[entry], sizeof(this->latencyMnemonics[entry]), "%s", mnemonic);
+        this->latencies[entry] = latency;
+        if (entry == this->numLatencies) this->numLatencies++;
+    }
+    epicsMutexUnlock(this->mutex);
+}
+
+/** Injects a fault.
+  *
+  * \param[in] fault  drop (percentage of replies never sent), error (percentage of replies replaced by an error),
+  *                   or the motor fault query of an axis (e.g. XMF) to force its value, non-zero also aborting motion and switching the motor off
+  * \param[in] value  Percentage, or motor fault value
+  *
+  * \return asynError if the fault is unknown
+  */
+asynStatus FlexDCSimulator::setFault(const char *fault, int value) {
+    asynStatus status = asynSuccess;
+    const char *axis_letter;
+    FlexDCSimAxis *p_axis;
+
+    epicsMutexMustLock(this->mutex);
+    if (!strcmp(fault, "drop")) {
+        this->dropPercent = (value < 0) ? 0 : (value > 100) ? 100 : value;
+    } else if (!strcmp(fault, "error")) {
+        this->errorPercent = (value < 0) ? 0 : (value > 100) ? 100 : value;
+    } else if ((strlen(fault) == 3) && (!strcmp(fault+1, "MF")) && ((axis_letter = (const char *)memchr(CTRL_AXES, fault[0], CTRL_NUM_AXES)))) {
+        p_axis = &this->axes[axis_letter-CTRL_AXES];
+        p_axis->motorFault = value;
+        if (value) {
+            stopAxis(p_axis, MOTOR_FAULT);
+            p_axis->motorOn = false;
+        }
+    } else {
+        status = asynError;
+    }
+    epicsMutexUnlock(this->mutex);
+
+    return status;
+}
+
+/** Processes a command line, and builds its reply.
+  *
+  * \param[in]  line        The ';'-chained commands, without EOS
+  * \param[out] reply       The ';'-separated values of the queries, followed by the acknowledgement
+  * \param[in]  reply_size  Size of reply
+  * \param[out] latency     How long to wait before sending the reply, in seconds
+  *
+  * \return false if the reply must be dropped
+  */
+bool FlexDCSimulator::processLine(const char *line, char *reply, size_t reply_size, double *latency) {
+    char command[MAX_CONTROLLER_STRING_SIZE];
+    const char *end;
+    size_t len;
+    bool send_reply = true;
+
+    *latency = 0.0;
+    reply[0] = '\0';
+
+    epicsMutexMustLock(this->mutex);
+    updateKinematics();
+
+    if ((this->dropPercent) && (rand()%100 < this->dropPercent)) {
+        send_reply = false;
+    } else if ((this->errorPercent) && (rand()%100 < this->errorPercent)) {
+        snprintf(reply, reply_size, "%s", SIM_ERROR_REPLY);
+    } else {
+        while (*line) {
+            end = strchr(line, CMD_SEPARATOR);
+            if (!end) end = line+strlen(line);
+            len = end-line;
+            if (len >= sizeof(command)) len = sizeof(command)-1;
+            memcpy(command, line, len);
+            command[len] = '\0';
+
+            if (len) {
+                *latency += processCommand(command, reply, reply_size-1);
+            }
+            line = *end ? end+1 : end;
+        }
+    }
+    epicsMutexUnlock(this->mutex);
+
+    len = strlen(reply);
+    reply[len] = SIM_ACKNOWLEDGE;
+    reply[len+1] = '\0';
+
+    return send_reply;
+}
+
+/** Executes a single command, appending the value of a query to the reply values.
+  * Malformed commands get an error value.
+  *
+  * \param[in]     command      The command, starting with its axis letter
+  * \param[in,out] values       The reply values so far
+  * \param[in]     values_size  Size of values
+  *
+  * \return Delay before replying to this command, in seconds
+  */
+double FlexDCSimulator::processCommand(const char *command, char *values, size_t values_size) {
+    char mnemonic[3], key[MAX_CONTROLLER_STRING_SIZE], value_text[32];
+    const char *p, *axis_letter, *argument = NULL;
+    char *end;
+    long value = 0, index = -1;
+    bool is_set = false, is_query, valid = true;
+    double latency = this->defaultLatency;
+    int first_axis = 0, last_axis = CTRL_NUM_AXES-1, axis, entry;
+    FlexDCSimAxis *p_axis;
+    std::map<std::string, long>::iterator var;
+
+    // Axis letter, mnemonic, optional [index], optional =value or ,argument
+    if (command[0] != CTRL_ALL_AXES) {
+        axis_letter = (const char *)memchr(CTRL_AXES, command[0], CTRL_NUM_AXES);
+        if (axis_letter) {
+            first_axis = last_axis = axis_letter-CTRL_AXES;
+        } else {
+            valid = false;
+        }
+    }
+    valid = valid && (isupper((unsigned char)command[1])) && (isupper((unsigned char)command[2]));
+    if (valid) {
+        mnemonic[0] = command[1];
+        mnemonic[1] = command[2];
+        mnemonic[2] = '\0';
+        p = command+3;
+        if (*p == '[') {
+            index = strtol(p+1, &end, 10);
+            valid = (*end == ']');
+            p = end+1;
+        }
+        if ((valid) && (*p == '=')) {
+            is_set = true;
+            value = strtol(p+1, &end, 10);
+            valid = (end != p+1) && (!*end);
+            snprintf(key, sizeof(key), "%.*s", (int)(p-command), command);
+        } else if ((valid) && (*p == ',')) {
+            argument = p+1;
+        } else if (valid) {
+            valid = (!*p);
+            snprintf(key, sizeof(key), "%s", command);
+        }
+    }
+    if (!valid) {
+        snprintf(values+strlen(values), values_size-strlen(values), "%s%s", values[0] ? ";" : "", SIM_ERROR_REPLY);
+        return latency;
+    }
+    // Motion and macro commands have no value to reply
+    is_query = (!is_set) && (!argument) && (!strstr(SIM_ACTION_COMMANDS, mnemonic));
+
+    for (entry=0; entry<this->numLatencies; entry++) {
+        if (!strcmp(this->latencyMnemonics[entry], mnemonic)) latency = this->latencies[entry];
+    }
+
+    value_text[0] = '\0';
+    for (axis=first_axis; axis<=last_axis; axis++) {
+        p_axis = &this->axes[axis];
+
+        if (!strcmp(mnemonic, "VR")) {
+            snprintf(value_text, sizeof(value_text), "%s", SIM_VERSION);
+        } else if (!strcmp(mnemonic, "PS")) {
+            if (is_set) {
+                p_axis->position = p_axis->target = value;
+            }
+            value = lround(p_axis->position);
+        } else if (!strcmp(mnemonic, "PE")) {
+            value = p_axis->moving ? SIM_FOLLOWING_ERROR : 0;
+        } else if (!strcmp(mnemonic, "MO")) {
+            if (is_set) {
+                p_axis->motorOn = (value != 0);
+                if ((!p_axis->motorOn) && ((p_axis->moving) || (p_axis->homing))) {
+                    stopAxis(p_axis, MOTOR_OFF);
+                }
+            }
+            value = p_axis->motorOn;
+        } else if (!strcmp(mnemonic, "MS")) {
+            value = ((p_axis->moving) || (p_axis->homing)) ? SIM_MOVING_STATUS : 0;
+        } else if (!strcmp(mnemonic, "EM")) {
+            value = p_axis->motionEnd;
+        } else if (!strcmp(mnemonic, "MF")) {
+            value = p_axis->motorFault;
+        } else if (!strcmp(mnemonic, "SP")) {
+            if ((is_set) && (value > 0)) {
+                p_axis->speed = value;
+            }
+            value = p_axis->speed;
+        } else if ((!strcmp(mnemonic, "AP")) || (!strcmp(mnemonic, "RP"))) {
+            if (is_set) {
+                p_axis->relative = (mnemonic[0] == 'R');
+                p_axis->pendingPosition = value;
+            }
+            value = p_axis->pendingPosition;
+        } else if (!strcmp(mnemonic, "BG")) {
+            if (!p_axis->motorOn) {
+                p_axis->motionEnd = MOTOR_OFF;
+            } else if (p_axis->motorFault) {
+                p_axis->motionEnd = MOTOR_FAULT;
+            } else {
+                p_axis->target = p_axis->relative ? p_axis->position+p_axis->pendingPosition : p_axis->pendingPosition;
+                p_axis->moving = true;
+                p_axis->motionEnd = IN_MOTION;
+            }
+        } else if (!strcmp(mnemonic, "ST")) {
+            stopAxis(p_axis, USER_STOP);
+        } else if ((!strcmp(mnemonic, "QE")) && (argument)) {
+            // Homing macros switch the motor on and end at the home position
+            p_axis->motorOn = true;
+            p_axis->target = 0;
+            p_axis->moving = true;
+            p_axis->homing = true;
+            p_axis->macroResult = EXECUTING;
+            p_axis->motionEnd = IN_MOTION;
+        } else if ((!strcmp(mnemonic, "QK")) || (!strcmp(mnemonic, "QH"))) {
+            if (p_axis->homing) {
+                stopAxis(p_axis, USER_STOP);
+                p_axis->macroResult = FAIL_NO_INDEX_FOUND;
+            }
+        } else if ((!strcmp(mnemonic, "PA")) && (index == 11)) {
+            if (is_set) {
+                p_axis->macroResult = value;
+            }
+            value = p_axis->macroResult;
+        } else if (!strcmp(mnemonic, "RS")) {
+            // Like a power cycle, a reset also clears all variables
+            this->variables.clear();
+            resetAxes();
+            break;
+        } else if (!strcmp(mnemonic, "QI")) {
+            // Nothing to initialize
+        } else if (is_set) {
+            key[0] = CTRL_AXES[axis];
+            this->variables[key] = value;
+        } else if (is_query) {
+            key[0] = CTRL_AXES[axis];
+            var = this->variables.find(key);
+            value = (var != this->variables.end()) ? var->second : 0;
+        }
+
+        if ((is_query) && (!value_text[0])) {
+            snprintf(value_text, sizeof(value_text), "%ld", value);
+        }
+    }
+
+    if (is_query) {
+        snprintf(values+strlen(values), values_size-strlen(values), "%s%s", values[0] ? ";" : "", value_text);
+    }
+
+    return latency;
+}
+
+/** Moves all moving axes towards their target, at their speed, for the time elapsed since the last update.
+  * Called with the simulator mutex held.
+  *
+  */
+void FlexDCSimulator::updateKinematics() {
+    FlexDCSimAxis *p_axis;
+    epicsTimeStamp now;
+    double step;
+    int axis;
+
+    epicsTimeGetCurrent(&now);
+    for (axis=0; axis<CTRL_NUM_AXES; axis++) {
+        p_axis = &this->axes[axis];
+        if (!p_axis->moving) continue;
+
+        step = p_axis->speed*epicsTimeDiffInSeconds(&now, &this->lastUpdate);
+        if (fabs(p_axis->target-p_axis->position) <= step) {
+            p_axis->position = p_axis->target;
+            p_axis->moving = false;
+            p_axis->motionEnd = NORMAL;
+            if (p_axis->homing) {
+                p_axis->homing = false;
+                p_axis->macroResult = OK;
+            }
+        } else {
+            p_axis->position += (p_axis->target > p_axis->position) ? step : -step;
+        }
+    }
+    this->lastUpdate = now;
+}
+
+/** Stops an axis where it is.
+  *
+  * \param[in] axis    The axis
+  * \param[in] reason  Why the motion ended
+  */
+void FlexDCSimulator::stopAxis(FlexDCSimAxis *axis, flexdcMotionEndReason reason) {
+    axis->target = axis->position;
+    axis->moving = false;
+    axis->homing = false;
+    axis->motionEnd = reason;
+}
+
+/** Puts all axes back to their power-up state: switched off at position 0, no fault.
+  *
+  */
+void FlexDCSimulator::resetAxes() {
+    int axis;
+
+    for (axis=0; axis<CTRL_NUM_AXES; axis++) {
+        this->axes[axis].position = 0.0;
+        this->axes[axis].target = 0.0;
+        this->axes[axis].speed = SIM_DEFAULT_SPEED;
+        this->axes[axis].relative = false;
+        this->axes[axis].pendingPosition = 0;
+        this->axes[axis].motorOn = false;
+        this->axes[axis].moving = false;
+        this->axes[axis].homing = false;
+        this->axes[axis].motionEnd = MOTOR_OFF;
+        this->axes[axis].motorFault = 0;
+        this->axes[axis].macroResult = OK;
+    }
+    epicsTimeGetCurrent(&this->lastUpdate);
+}
+
+/** Body of the listening thread.
+  *
+  */
+void FlexDCSimulator::listenThread() {
+    FlexDCSimConnection *p_connection;
+    char thread_name[32];
+    SOCKET sock;
+
+    while (true) {
+        sock = epicsSocketAccept(this->listenSocket, NULL, NULL);
+        if (sock == INVALID_SOCKET) {
+            epicsThreadSleep(0.1);
+            continue;
+        }
+
+        p_connection = new FlexDCSimConnection;
+        p_connection->simulator = this;
+        p_connection->sock = sock;
+        snprintf(thread_name, sizeof(thread_name), "FlexDCSimConn_%d", this->tcpPort);
+        epicsThreadCreate(thread_name, epicsThreadPriorityMedium, epicsThreadGetStackSize(epicsThreadStackMedium), connectionThreadC, p_connection);
+    }
+}
+
+/** Body of a connection thread: processes every line received, in order, until the peer disconnects.
+  *
+  * \param[in] sock  The accepted connection
+  */
+void FlexDCSimulator::connectionThread(SOCKET sock) {
+    char buffer[4*MAX_CONTROLLER_STRING_SIZE];
+    char line[MAX_CONTROLLER_STRING_SIZE];
+    char reply[MAX_CONTROLLER_STRING_SIZE+2];
+    char *start, *p;
+    size_t used = 0, len;
+    double latency;
+    int received;
+
+    while ((received = recv(sock, buffer+used, sizeof(buffer)-used, 0)) > 0) {
+        used += received;
+
+        // Lines end with CR and/or LF
+        start = buffer;
+        for (p=buffer; p<buffer+used; p++) {
+            if ((*p != '\r') && (*p != '\n')) continue;
+
+            len = p-start;
+            if (len) {
+                if (len >= sizeof(line)) len = sizeof(line)-1;
+                memcpy(line, start, len);
+                line[len] = '\0';
+
+                if (processLine(line, reply, sizeof(reply), &latency)) {
+                    if (latency > 0.0) epicsThreadSleep(latency);
+                    send(sock, reply, strlen(reply), 0);
+                }
+            }
+            start = p+1;
+        }
+
+        used = buffer+used-start;
+        memmove(buffer, start, used);
+        if (used == sizeof(buffer)) {
+            // Line too long, discard it
+            used = 0;
+        }
+    }
+
+    epicsSocketDestroy(sock);
+}
+
+/** Retrieves the simulator listening to a TCP port.
+  *
+  * \param[in] tcpPort  The TCP port
+  *
+  * \return The simulator, or NULL if none
+  */
+FlexDCSimulator* FlexDCSimulator::find(int tcpPort) {
+    FlexDCSimulator *p_simulator;
+
+    for (p_simulator=simulators; p_simulator; p_simulator=p_simulator->next) {
+        if (p_simulator->tcpPort == tcpPort) break;
+    }
+    return p_simulator;
+}
+
+void FlexDCSimulator::log(const char *format, ...) {
+    va_list arglist;
+    va_start(arglist, format);
+    errlogVprintf(format, arglist);
+    va_end(arglist);
+}
+
+
+
+/** Creates a FlexDC simulator listening to a loopback TCP port.
+  * Configuration command, called directly or from iocsh, before the asyn IP port connecting to it.
+  *
+  * \param[in] tcpPort  The TCP port, on 127.0.0.1
+  * \param[in] latency  Default delay in us before replying to each command
+  *
+  * \return asynSuccess if listening
+  */
+extern "C" int NMFlexDCSimulator(int tcpPort, int latency) {
+    if (FlexDCSimulator::find(tcpPort)) {
+        errlogPrintf("A FlexDC simulator already listens to port %d\n", tcpPort);
+        return asynError;
+    }
+    return (new FlexDCSimulator(tcpPort, latency/1.e6))->start();
+}
+
+/** Sets the delay before a FlexDC simulator replies to a given command.
+  *
+  * \param[in] tcpPort   The TCP port of the simulator
+  * \param[in] mnemonic  The two-letter command (e.g. PS, BG)
+  * \param[in] latency   Delay in us
+  *
+  * \return asynError if there is no such simulator
+  */
+extern "C" int NMFlexDCSimulatorLatency(int tcpPort, const char *mnemonic, int latency) {
+    FlexDCSimulator *p_simulator = FlexDCSimulator::find(tcpPort);
+
+    if ((!p_simulator) || (!mnemonic)) {
+        errlogPrintf("No FlexDC simulator on port %d\n", tcpPort);
+        return asynError;
+    }
+    p_simulator->setLatency(mnemonic, latency/1.e6);
+    return asynSuccess;
+}
+
+/** Injects a fault into a FlexDC simulator.
+  *
+  * \param[in] tcpPort  The TCP port of the simulator
+  * \param[in] fault    drop, error (percentage of replies), or XMF/YMF (forced motor fault value)
+  * \param[in] value    Percentage, or motor fault value
+  *
+  * \return asynError if there is no such simulator or fault
+  */
+extern "C" int NMFlexDCSimulatorFault(int tcpPort, const char *fault, int value) {
+    FlexDCSimulator *p_simulator = FlexDCSimulator::find(tcpPort);
+
+    if ((!p_simulator) || (!fault) || (p_simulator->setFault(fault, value) != asynSuccess)) {
+        errlogPrintf("No FlexDC simulator on port %d, or unknown fault\n", tcpPort);
+        return asynError;
+    }
+    return asynSuccess;
+}
+
+/** Code for iocsh registration */
+static const iocshArg NMFlexDCSimulatorArg0 = { "TCP port", iocshArgInt };
+static const iocshArg NMFlexDCSimulatorArg1 = { "Latency (us)", iocshArgInt };
+static const iocshArg * const NMFlexDCSimulatorArgs[] = { &NMFlexDCSimulatorArg0,
+                                                          &NMFlexDCSimulatorArg1 };
+static const iocshFuncDef NMFlexDCSimulatorDef = { "NMFlexDCSimulator", 2, NMFlexDCSimulatorArgs };
+static void NMFlexDCSimulatorCallFunc(const iocshArgBuf *args) {
+    NMFlexDCSimulator(args[0].ival, args[1].ival);
+}
+
+static const iocshArg NMFlexDCSimulatorLatencyArg0 = { "TCP port", iocshArgInt };
+static const iocshArg NMFlexDCSimulatorLatencyArg1 = { "Command", iocshArgString };
+static const iocshArg NMFlexDCSimulatorLatencyArg2 = { "Latency (us)", iocshArgInt };
+static const iocshArg * const NMFlexDCSimulatorLatencyArgs[] = { &NMFlexDCSimulatorLatencyArg0,
+                                                                 &NMFlexDCSimulatorLatencyArg1,
+                                                                 &NMFlexDCSimulatorLatencyArg2 };
+static const iocshFuncDef NMFlexDCSimulatorLatencyDef = { "NMFlexDCSimulatorLatency", 3, NMFlexDCSimulatorLatencyArgs };
+static void NMFlexDCSimulatorLatencyCallFunc(const iocshArgBuf *args) {
+    NMFlexDCSimulatorLatency(args[0].ival, args[1].sval, args[2].ival);
+}
+
+static const iocshArg NMFlexDCSimulatorFaultArg0 = { "TCP port", iocshArgInt };
+static const iocshArg NMFlexDCSimulatorFaultArg1 = { "Fault", iocshArgString };
+static const iocshArg NMFlexDCSimulatorFaultArg2 = { "Value", iocshArgInt };
+static const iocshArg * const NMFlexDCSimulatorFaultArgs[] = { &NMFlexDCSimulatorFaultArg0,
+                                                               &NMFlexDCSimulatorFaultArg1,
+                                                               &NMFlexDCSimulatorFaultArg2 };
+static const iocshFuncDef NMFlexDCSimulatorFaultDef = { "NMFlexDCSimulatorFault", 3, NMFlexDCSimulatorFaultArgs };
+static void NMFlexDCSimulatorFaultCallFunc(const iocshArgBuf *args) {
+    NMFlexDCSimulatorFault(args[0].ival, args[1].sval, args[2].ival);
+}
+
+static void NMFlexDCSimulatorRegister(void) {
+    iocshRegister(&NMFlexDCSimulatorDef, NMFlexDCSimulatorCallFunc);
+    iocshRegister(&NMFlexDCSimulatorLatencyDef, NMFlexDCSimulatorLatencyCallFunc);
+    iocshRegister(&NMFlexDCSimulatorFaultDef, NMFlexDCSimulatorFaultCallFunc);
+}
+
+extern "C" {
+    epicsExportRegistrar(NMFlexDCSimulatorRegister);
+}
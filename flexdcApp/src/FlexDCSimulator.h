@@ -0,0 +1,103 @@
+/*
+FILENAME...   FlexDCSimulator.h
+USAGE...      In-process TCP simulator of the Nanomotion FlexDC controller, for tests without hardware
+
+Jose G.C. Gabadinho
+April 2021
+*/
+
+#ifndef _FLEXDCSIMULATOR_H_
+#define _FLEXDCSIMULATOR_H_
+
+#include <map>
+#include <string>
+
+#include <epicsMutex.h>
+#include <epicsTime.h>
+#include <osiSock.h>
+
+#include "FlexDCMotorDriver.h"
+
+
+
+#define FLEXDC_SIM_MAX_LATENCIES 32
+
+const char SIM_VERSION[] = "FlexDC simulator 1.0";
+const char SIM_ERROR_REPLY[] = "?";
+const char SIM_ACKNOWLEDGE = '>';
+const char SIM_ACTION_COMMANDS[] = "BG ST QK QH QI RS";
+
+const long SIM_DEFAULT_SPEED = 10000;     // counts/s, until SP is set
+const long SIM_FOLLOWING_ERROR = 5;       // counts, reported as PE while moving
+const int  SIM_MOVING_STATUS = 2;         // MS value while moving or homing
+
+
+
+struct FlexDCSimAxis {
+    double position;
+    double target;
+    long speed;
+    bool relative;
+    long pendingPosition;
+    bool motorOn;
+    bool moving;
+    bool homing;
+    flexdcMotionEndReason motionEnd;
+    long motorFault;
+    long macroResult;
+};
+
+
+
+/** Speaks the command set used by the driver on a loopback TCP port: ';'-chained commands terminated by CR and/or LF,
+  * whose query values are replied ';'-separated and followed by the '>' acknowledgement.
+  * Axes move at their SP speed towards their target once begun; homing macros move to 0; a reset also clears all variables.
+  * Replies can be delayed per command mnemonic, and dropped or replaced by an error at a given rate.
+  */
+class FlexDCSimulator {
+
+public:
+    FlexDCSimulator(int tcpPort, double latency);
+
+    asynStatus start();
+
+    void setLatency(const char *mnemonic, double latency);
+    asynStatus setFault(const char *fault, int value);
+
+    bool processLine(const char *line, char *reply, size_t reply_size, double *latency);
+
+    void listenThread();
+    void connectionThread(SOCKET sock);
+
+    static FlexDCSimulator* find(int tcpPort);
+
+protected:
+    virtual double processCommand(const char *command, char *values, size_t values_size);
+    virtual void updateKinematics();
+    virtual void resetAxes();
+    virtual void stopAxis(FlexDCSimAxis *axis, flexdcMotionEndReason reason);
+
+    virtual void log(const char *format, ...);
+
+    int tcpPort;
+    SOCKET listenSocket;
+
+private:
+    epicsMutexId mutex;
+    FlexDCSimAxis axes[CTRL_NUM_AXES];
+    std::map<std::string, long> variables;
+    epicsTimeStamp lastUpdate;
+
+    double defaultLatency;
+    char latencyMnemonics[FLEXDC_SIM_MAX_LATENCIES][8];
+    double latencies[FLEXDC_SIM_MAX_LATENCIES];
+    int numLatencies;
+
+    int dropPercent;
+    int errorPercent;
+
+    FlexDCSimulator *next;
+    static FlexDCSimulator *simulators;
+};
+
+#endif // _FLEXDCSIMULATOR_H_
@@ -0,0 +1,124 @@
+/*
+FILENAME...   FlexDCSnapshot.h
+USAGE...      Persistent snapshot of the axes state of the Nanomotion FlexDC controller, for fast IOC restarts
+
+Jose G.C. Gabadinho
+April 2021
+*/
+
+#ifndef _FLEXDCSNAPSHOT_H_
+#define _FLEXDCSNAPSHOT_H_
+
+#include <stdio.h>
+#include <string.h>
+
+#include <epicsTypes.h>
+
+
+
+#define FLEXDC_SNAPSHOT_MAGIC   "FLEXDCSS"
+#define FLEXDC_SNAPSHOT_VERSION 2
+
+
+
+/** File header, followed by numAxes FlexDCAxisSnapshot records. All fields are in host byte order.
+  * The token is the one the saving IOC wrote to the controller units, which lose it on reset or power cycle.
+  *
+  */
+struct FlexDCSnapshotHeader {
+    char magic[8];
+    epicsUInt32 version;
+    epicsUInt32 numAxes;
+    epicsInt32 token;
+};
+
+struct FlexDCAxisSnapshot {
+    epicsInt32 position;
+    epicsInt32 homed;
+    epicsInt32 motionEnd;
+};
+
+
+
+/** Reads and writes snapshot files.
+  * Files are replaced atomically: written in full next to the snapshot, then renamed over it.
+  */
+class FlexDCSnapshot {
+
+public:
+    /** Reads a snapshot.
+      *
+      * \param[in]  path       The snapshot file
+      * \param[out] axes       Its axis records
+      * \param[in]  max_axes   Size of axes
+      * \param[out] token      Controller token it was saved with
+      *
+      * \return Number of axes read, or -1 if the file is missing, of another version, or truncated
+      */
+    static int read(const char *path, FlexDCAxisSnapshot *axes, int max_axes, epicsInt32 *token) {
+        FlexDCSnapshotHeader header;
+        FILE *fp;
+        int num_axes = -1;
+
+        fp = fopen(path, "rb");
+        if (!fp) {
+            return -1;
+        }
+        if ((fread(&header, sizeof(header), 1, fp) == 1) && (!memcmp(header.magic, FLEXDC_SNAPSHOT_MAGIC, sizeof(header.magic))) &&
+            (header.version == FLEXDC_SNAPSHOT_VERSION)) {
+            num_axes = (header.numAxes < (epicsUInt32)max_axes) ? (int)header.numAxes : max_axes;
+            if (fread(axes, sizeof(*axes), num_axes, fp) != (size_t)num_axes) {
+                num_axes = -1;
+            }
+            *token = header.token;
+        }
+        fclose(fp);
+
+        return num_axes;
+    }
+
+    /** Writes a snapshot, replacing any previous one only once complete.
+      *
+      * \param[in] path      The snapshot file
+      * \param[in] axes      The axis records
+      * \param[in] num_axes  Number of axis records
+      * \param[in] token     Controller token to save with them
+      *
+      * \return false if it could not be written
+      */
+    static bool write(const char *path, const FlexDCAxisSnapshot *axes, int num_axes, epicsInt32 token) {
+        FlexDCSnapshotHeader header;
+        char tmp_path[512];
+        FILE *fp;
+        bool written;
+
+        if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= (int)sizeof(tmp_path)) {
+            return false;
+        }
+        fp = fopen(tmp_path, "wb");
+        if (!fp) {
+            return false;
+        }
+
+        memcpy(header.magic, FLEXDC_SNAPSHOT_MAGIC, sizeof(header.magic));
+        header.version = FLEXDC_SNAPSHOT_VERSION;
+        header.numAxes = num_axes;
+        header.token = token;
+        written = (fwrite(&header, sizeof(header), 1, fp) == 1) && (fwrite(axes, sizeof(*axes), num_axes, fp) == (size_t)num_axes);
+        written = (fclose(fp) == 0) && (written);
+
+#ifdef _WIN32
+        // rename() does not replace an existing file there; a crash in between leaves the .tmp one, and no snapshot
+        if (written) {
+            remove(path);
+        }
+#endif
+        if ((!written) || (rename(tmp_path, path))) {
+            remove(tmp_path);
+            return false;
+        }
+        return true;
+    }
+};
+
+#endif // _FLEXDCSNAPSHOT_H_
@@ -14,6 +14,8 @@ asynSetTraceMask("NMCTRL", 0, 0x03)
 asynSetTraceIOMask("NMCTRL", 0, 0x04)
 
 # NMFlexDCCreateController(portName, asynPort, numAxes, movingPollingRate, idlePollingRate)
+# (asynPort can be a comma-separated list of asyn ports, one per FlexDC unit, two axes each)
+# (an optional sixth argument names a file where the axes state is saved, to restore homed axes at the next start)
 NMFlexDCCreateController("NMFLEXDC", "NMCTRL", 2, 50, 200)
 
 # Turn off asyn trace
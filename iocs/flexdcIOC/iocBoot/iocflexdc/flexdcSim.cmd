@@ -0,0 +1,26 @@
+# Nanomotion FlexDC controller support, against the in-process simulator
+
+# Load motor record
+dbLoadTemplate("flexdc.substitutions")
+
+# Start the simulator: NMFlexDCSimulator(tcpPort, latency us)
+NMFlexDCSimulator(4000, 500)
+
+# Configure asyn IP address
+drvAsynIPPortConfigure("NMCTRL", "127.0.0.1:4000")
+
+# Load asyn record
+dbLoadRecords("$(ASYN)/db/asynRecord.db", "P=FLEXDC:, R=ASYN1, PORT=NMCTRL, ADDR=0, OMAX=256, IMAX=256")
+
+# Turn on asyn trace
+asynSetTraceMask("NMCTRL", 0, 0x03)
+asynSetTraceIOMask("NMCTRL", 0, 0x04)
+
+# NMFlexDCCreateController(portName, asynPort, numAxes, movingPollingRate, idlePollingRate)
+# (asynPort can be a comma-separated list of asyn ports, one per FlexDC unit, two axes each)
+# (an optional sixth argument names a file where the axes state is saved, to restore homed axes at the next start)
+NMFlexDCCreateController("NMFLEXDC", "NMCTRL", 2, 50, 200)
+
+# Turn off asyn trace
+asynSetTraceMask("NMCTRL", 0, 0x01)
+asynSetTraceIOMask("NMCTRL", 0, 0x00)
@@ -12,6 +12,8 @@ cd "${TOP}/iocBoot/${IOC}"
 
 ##
 < flexdc.cmd
+# Or, without hardware:
+#< flexdcSim.cmd
 
 iocInit
 
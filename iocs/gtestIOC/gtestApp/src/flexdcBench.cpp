@@ -0,0 +1,300 @@
+/*
+FILENAME...   flexdcBench.cpp
+USAGE...      Benchmarks of the Nanomotion FlexDC driver hot paths, against a simulated controller
+
+Jose G.C. Gabadinho
+April 2021
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+#include <epicsAtomic.h>
+#include <epicsTime.h>
+
+#include "FlexDCMotorDriver.h"
+
+
+
+/** All allocations through operator new are counted, to catch any on the hot paths.
+  *
+  */
+static size_t allocations = 0;
+
+void* operator new(size_t size) {
+    void *p;
+
+    epicsAtomicIncrSizeT(&allocations);
+    p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t size) noexcept {
+    free(p);
+}
+
+
+
+/** Answers each command locally, instead of going through an octet port.
+  * Every subcommand without an assignment is a query, answered with a fixed plausible value,
+  * and the values of chained queries are separated as the controller does.
+  *
+  */
+class SimulatedQueue: public FlexDCCommandQueue {
+
+public:
+    SimulatedQueue(const char *name): FlexDCCommandQueue(name, NULL), roundTrips(0) {}
+
+    size_t getRoundTrips() {
+        return epicsAtomicGetSizeT(&this->roundTrips);
+    }
+
+    static void simulate(const char *command, char *reply, size_t reply_size) {
+        static const char *queries[][2] = {
+            { "PS", "100000" }, { "PE", "2" }, { "MO", "1" }, { "MS", "0" }, { "EM", "1" }, { "MF", "0" }, { "PA[11]", "1" }
+        };
+        const char *end;
+        const char *value;
+        size_t len, used = 0;
+        unsigned int query;
+        bool first = true;
+
+        reply[0] = '\0';
+        while (*command) {
+            end = strchr(command, CMD_SEPARATOR);
+            if (!end) end = command+strlen(command);
+            len = end-command;
+
+            if ((len > 1) && (!memchr(command, '=', len))) {
+                value = "0";
+                for (query=0; query<sizeof(queries)/sizeof(*queries); query++) {
+                    if ((strlen(queries[query][0]) == len-1) && (!strncmp(command+1, queries[query][0], len-1))) {
+                        value = queries[query][1];
+                    }
+                }
+                used += snprintf(reply+used, reply_size-used, "%s%s", first ? "" : ";", value);
+                if (used >= reply_size) used = reply_size-1;
+                first = false;
+            }
+            command = *end ? end+1 : end;
+        }
+    }
+
+protected:
+    void transfer(FlexDCRequest **requests, int num_requests) {
+        int req;
+
+        for (req=0; req<num_requests; req++) {
+            simulate(requests[req]->command, requests[req]->reply, sizeof(requests[req]->reply));
+            requests[req]->status = asynSuccess;
+            epicsAtomicIncrSizeT(&this->roundTrips);
+        }
+    }
+
+    void log(int reason, const char *format, ...) {}
+
+private:
+    size_t roundTrips;
+};
+
+
+
+class BenchAxis: public FlexDCAxis {
+
+public:
+    BenchAxis(FlexDCController *pC, int axis): FlexDCAxis(pC, axis) {}
+
+    asynStatus setMotionDone(int motion_status, flexdcMacroResult macro_result, bool power_on, long pos_error) {
+        return FlexDCAxis::setMotionDone(motion_status, macro_result, power_on, pos_error);
+    }
+
+protected:
+    void log(int reason, const char *format, ...) {}
+};
+
+
+
+/** Controller whose units are all simulated, and which is only polled on request.
+  *
+  */
+class BenchController: public FlexDCController {
+
+public:
+    BenchController(): FlexDCController("BENCH", "BENCH_SIM0,BENCH_SIM1", 4, 0.01, 0.1) {
+        char name[32];
+        int unit, axis;
+
+        this->shuttingDown_ = 1; // Stop the poller and capture threads, cycles are run by pollCycle()
+
+        for (unit=0; unit<this->numUnits; unit++) {
+            snprintf(name, sizeof(name), "BENCH_SIM%d", unit);
+            this->queues[unit] = new SimulatedQueue(name);
+            this->units[unit].commandQueue = this->queues[unit];
+        }
+        for (axis=0; axis<this->numAxes_; axis++) {
+            new BenchAxis(this, axis);
+            setDoubleParam(axis, driverMotorRecResolution, 1.0);
+            setDoubleParam(axis, driverRetryDeadband, 5.0);
+        }
+    }
+
+    size_t getRoundTrips() {
+        size_t round_trips = 0;
+        int unit;
+
+        for (unit=0; unit<this->numUnits; unit++) {
+            round_trips += this->queues[unit]->getRoundTrips();
+        }
+        return round_trips;
+    }
+
+    void setPollMode(flexdcPollMode mode) {
+        this->pollMode = mode;
+    }
+
+    void pollCycle() {
+        bool moving;
+        int axis;
+
+        lock();
+        poll();
+        for (axis=0; axis<this->numAxes_; axis++) {
+            getAxis(axis)->poll(&moving);
+        }
+        unlock();
+    }
+
+    BenchAxis* getBenchAxis(int axis) {
+        return static_cast<BenchAxis*>(getAxis(axis));
+    }
+
+    void log(int reason, const char *format, ...) {}
+
+private:
+    SimulatedQueue *queues[FLEXDC_MAX_UNITS];
+};
+
+
+
+typedef void (*BenchFunction)(BenchController *controller);
+
+/** Runs a function for a number of iterations, and prints its cost per call.
+  *
+  */
+static void runBenchmark(const char *name, BenchFunction function, BenchController *controller, long iterations) {
+    epicsTimeStamp start, end;
+    size_t allocations_before, round_trips_before;
+    double elapsed;
+    long i;
+
+    function(controller); // Warm up
+
+    allocations_before = epicsAtomicGetSizeT(&allocations);
+    round_trips_before = controller->getRoundTrips();
+    epicsTimeGetCurrent(&start);
+    for (i=0; i<iterations; i++) {
+        function(controller);
+    }
+    epicsTimeGetCurrent(&end);
+    elapsed = epicsTimeDiffInSeconds(&end, &start);
+
+    printf("%-32s %12.1f ns/op %8.2f allocs/op %8.2f round trips/op\n", name, elapsed*1e9/iterations,
+           (double)(epicsAtomicGetSizeT(&allocations)-allocations_before)/iterations,
+           (double)(controller->getRoundTrips()-round_trips_before)/iterations);
+}
+
+static char bench_buffer[MAX_CONTROLLER_STRING_SIZE];
+static volatile long bench_sink;
+
+static void benchBuildMove(BenchController *controller) {
+    FlexDCAxis::buildMoveCommand(bench_buffer, 1, -123456, false, 25000);
+}
+
+static void benchBuildPoll(BenchController *controller) {
+    FlexDCAxis::buildPollCommand(bench_buffer, 0);
+}
+
+static void benchBuildControllerPoll(BenchController *controller) {
+    FlexDCAxis::buildControllerPollCommand(bench_buffer, CTRL_NUM_AXES);
+}
+
+static void benchBuildArrayChunk(BenchController *controller) {
+    static const double values[] = { 1000, 2000, 3000, 4000, 5000, 6000, 7000, 8000, 9000, 10000, 11000, 12000 };
+    FlexDCAxis::buildArrayChunkCommand(bench_buffer, CTRL_MAX_LINE_LENGTH, 0, AXIS_PROFILE_POS_ARRAY, 1, values, 12);
+}
+
+static void benchParseReplies(BenchController *controller) {
+    long readback, pos_error;
+    bool power;
+    int motion_status, fault;
+    flexdcMacroResult macro_result;
+    flexdcMotionEndReason motion_end;
+
+    FlexDCAxis::updateAxisReadbackPosition(asynSuccess, "-1234567", readback, NULL);
+    FlexDCAxis::updateAxisMotorPower(asynSuccess, "1", power, NULL);
+    FlexDCAxis::updateAxisMotionStatus(asynSuccess, "0", motion_status, NULL);
+    FlexDCAxis::updateAxisMacroResult(asynSuccess, "1", macro_result, NULL);
+    FlexDCAxis::updateAxisMotionEnd(asynSuccess, "1", motion_end, NULL);
+    FlexDCAxis::updateAxisPositionError(asynSuccess, "-12", pos_error, NULL);
+    FlexDCAxis::updateAxisMotorFault(asynSuccess, "0", fault, NULL);
+    bench_sink = readback + pos_error;
+}
+
+static void benchSplitReply(BenchController *controller) {
+    char reply[] = "100000;100000;1;1;0;0;1;1;1;1;2;2;0;0";
+    char *fields[2*NUM_POLL_FIELDS];
+    bench_sink = FlexDCAxis::splitReply(reply, fields, 2*NUM_POLL_FIELDS);
+}
+
+static void benchMotionDoneMoving(BenchController *controller) {
+    controller->getBenchAxis(0)->setMotionDone(1, OK, true, 100);
+}
+
+static void benchMotionDoneSettling(BenchController *controller) {
+    controller->getBenchAxis(0)->setMotionDone(0, OK, true, 100);
+}
+
+static void benchPollCycle(BenchController *controller) {
+    controller->pollCycle();
+}
+
+/** Usage: flexdcBench [iterations scale]
+  *
+  */
+int main(int argc, char **argv) {
+    double scale = (argc > 1) ? atof(argv[1]) : 1.0;
+    long fast = (long)(1000000*scale), slow = (long)(2000*scale);
+    BenchController *controller;
+
+    if (fast < 1) fast = 1;
+    if (slow < 1) slow = 1;
+
+    controller = new BenchController();
+
+    printf("FlexDC driver benchmarks, %d units of %d axes\n", FlexDCController::countUnits("BENCH_SIM0,BENCH_SIM1"), CTRL_NUM_AXES);
+
+    runBenchmark("build move", benchBuildMove, controller, fast);
+    runBenchmark("build axis poll", benchBuildPoll, controller, fast);
+    runBenchmark("build controller poll", benchBuildControllerPoll, controller, fast);
+    runBenchmark("build array chunk", benchBuildArrayChunk, controller, fast);
+    runBenchmark("parse poll replies", benchParseReplies, controller, fast);
+    runBenchmark("split batch reply", benchSplitReply, controller, fast);
+    runBenchmark("setMotionDone moving", benchMotionDoneMoving, controller, fast);
+    runBenchmark("setMotionDone settling", benchMotionDoneSettling, controller, fast);
+
+    controller->setPollMode(POLL_SEQUENTIAL);
+    runBenchmark("poll cycle, sequential", benchPollCycle, controller, slow);
+    controller->setPollMode(POLL_AXIS_BATCH);
+    runBenchmark("poll cycle, axis batch", benchPollCycle, controller, slow);
+    controller->setPollMode(POLL_CONTROLLER_BATCH);
+    runBenchmark("poll cycle, controller batch", benchPollCycle, controller, slow);
+
+    return 0;
+}
@@ -30,6 +30,105 @@ TEST(CommandBuild, MoveAbs_2_0_2000) {
 }
 
 
+TEST(CommandBuild, CoordinatedMove_Both) {
+    char buffer[STRING_BUFFER_SIZE];
+    flexdcDeferredMove moves[] = { { true, false, 100, 1000 }, { true, true, -5, 2000 } };
+    bool res = FlexDCAxis::buildCoordinatedMoveCommand(buffer, moves, 2);
+    ASSERT_EQ(true, res);
+    ASSERT_STREQ("XMO=1;XMM=0;XSM=0;XSP=1000;XAP=100;YMO=1;YMM=0;YSM=0;YSP=2000;YRP=-5;ABG", buffer);
+}
+
+TEST(CommandBuild, CoordinatedMove_Y) {
+    char buffer[STRING_BUFFER_SIZE];
+    flexdcDeferredMove moves[] = { { false, false, 100, 1000 }, { true, false, 300, 2000 } };
+    bool res = FlexDCAxis::buildCoordinatedMoveCommand(buffer, moves, 2);
+    ASSERT_EQ(true, res);
+    ASSERT_STREQ("YMO=1;YMM=0;YSM=0;YSP=2000;YAP=300;YBG", buffer);
+}
+
+TEST(CommandBuild, CoordinatedMove_None) {
+    char buffer[STRING_BUFFER_SIZE];
+    flexdcDeferredMove moves[] = { { false, false, 0, 0 }, { false, false, 0, 0 } };
+    bool res = FlexDCAxis::buildCoordinatedMoveCommand(buffer, moves, 2);
+    ASSERT_EQ(false, res);
+}
+
+
+TEST(CommandBuild, ArrayChunk_All) {
+    char buffer[STRING_BUFFER_SIZE];
+    double values[] = { 100, -4500.4, 2.6 };
+    int res = FlexDCAxis::buildArrayChunkCommand(buffer, STRING_BUFFER_SIZE-1, 1, "QP", 12, values, 3);
+    ASSERT_EQ(3, res);
+    ASSERT_STREQ("YQP[12]=100;YQP[13]=-4500;YQP[14]=3", buffer);
+}
+
+TEST(CommandBuild, ArrayChunk_Scaled) {
+    char buffer[STRING_BUFFER_SIZE];
+    double values[] = { 0.01, 0.004 };
+    int res = FlexDCAxis::buildArrayChunkCommand(buffer, STRING_BUFFER_SIZE-1, 0, "QT", 1, values, 2, 1000.0);
+    ASSERT_EQ(2, res);
+    ASSERT_STREQ("XQT[1]=10;XQT[2]=4", buffer);
+}
+
+TEST(CommandBuild, ArrayChunk_LineLimit) {
+    char buffer[STRING_BUFFER_SIZE];
+    double values[] = { 1, 2, 3, 4 };
+    int res = FlexDCAxis::buildArrayChunkCommand(buffer, 20, 0, "QP", 1, values, 4);
+    ASSERT_EQ(2, res);
+    ASSERT_STREQ("XQP[1]=1;XQP[2]=2", buffer);
+}
+
+TEST(CommandBuild, ArrayChunk_Index0) {
+    char buffer[STRING_BUFFER_SIZE];
+    double values[] = { 1 };
+    int res = FlexDCAxis::buildArrayChunkCommand(buffer, STRING_BUFFER_SIZE-1, 0, "QP", 0, values, 1);
+    ASSERT_EQ(0, res);
+}
+
+TEST(CommandBuild, ArrayQuery_All) {
+    char buffer[STRING_BUFFER_SIZE];
+    int res = FlexDCAxis::buildArrayQueryCommand(buffer, STRING_BUFFER_SIZE-1, 1, "RV2", 9, 3);
+    ASSERT_EQ(3, res);
+    ASSERT_STREQ("YRV2[9];YRV2[10];YRV2[11]", buffer);
+}
+
+TEST(CommandBuild, ArrayQuery_LineLimit) {
+    char buffer[STRING_BUFFER_SIZE];
+    int res = FlexDCAxis::buildArrayQueryCommand(buffer, 16, 0, "RV1", 1, 10);
+    ASSERT_EQ(2, res);
+    ASSERT_STREQ("XRV1[1];XRV1[2]", buffer);
+}
+
+TEST(CommandBuild, RecorderArm) {
+    char buffer[STRING_BUFFER_SIZE];
+    bool res = FlexDCAxis::buildRecorderArmCommand(buffer, 1, 4, 1000);
+    ASSERT_EQ(true, res);
+    ASSERT_STREQ("YRR=0;YRC=7;YRG=4;YRL=1000;YRR=2", buffer);
+}
+
+TEST(CommandBuild, RecorderArm_TooLong) {
+    char buffer[STRING_BUFFER_SIZE];
+    ASSERT_EQ(false, FlexDCAxis::buildRecorderArmCommand(buffer, 0, 1, FLEXDC_MAX_RECORD_POINTS+1));
+    ASSERT_EQ(false, FlexDCAxis::buildRecorderArmCommand(buffer, 0, 0, 100));
+}
+
+TEST(CommandBuild, ProfileStart_Both) {
+    char buffer[STRING_BUFFER_SIZE];
+    bool used[] = { true, true };
+    bool res = FlexDCAxis::buildProfileStartCommand(buffer, used, 2, 100);
+    ASSERT_EQ(true, res);
+    ASSERT_STREQ("XMP[1]=1;XMP[2]=100;XMP[3]=0;XPT=1;YMP[1]=1;YMP[2]=100;YMP[3]=0;YPT=1;ABG", buffer);
+}
+
+TEST(CommandBuild, ProfileStart_X) {
+    char buffer[STRING_BUFFER_SIZE];
+    bool used[] = { true, false };
+    bool res = FlexDCAxis::buildProfileStartCommand(buffer, used, 2, 3);
+    ASSERT_EQ(true, res);
+    ASSERT_STREQ("XMP[1]=1;XMP[2]=3;XMP[3]=0;XPT=1;XBG", buffer);
+}
+
+
 
 TEST(CommandBuild, SetPosition_0_100) {
     char buffer[STRING_BUFFER_SIZE];
@@ -209,6 +308,30 @@ TEST(CommandBuild, HomeMacro_1_Rev_Disa) {
     ASSERT_STREQ("MyBuffer", buffer);
 }
 
+TEST(CommandBuild, HomeAll_Both_Rev) {
+    char buffer[STRING_BUFFER_SIZE];
+    flexdcHomeMacro home_types[] = { HOME_LS, HOME_IDX };
+    bool res = FlexDCAxis::buildHomeAllCommand(buffer, home_types, 2, false);
+    ASSERT_EQ(true, res);
+    ASSERT_STREQ("XQE,#HINRIX;YQE,#HINX_Y", buffer);
+}
+
+TEST(CommandBuild, HomeAll_Y_For) {
+    char buffer[STRING_BUFFER_SIZE];
+    flexdcHomeMacro home_types[] = { DISABLED, HOME_LS };
+    bool res = FlexDCAxis::buildHomeAllCommand(buffer, home_types, 2, true);
+    ASSERT_EQ(true, res);
+    ASSERT_STREQ("YQE,#HINFIY", buffer);
+}
+
+TEST(CommandBuild, HomeAll_None) {
+    char buffer[STRING_BUFFER_SIZE] = "MyBuffer";
+    flexdcHomeMacro home_types[] = { DISABLED, DISABLED };
+    bool res = FlexDCAxis::buildHomeAllCommand(buffer, home_types, 2, true);
+    ASSERT_EQ(false, res);
+    ASSERT_STREQ("MyBuffer", buffer);
+}
+
 TEST(CommandBuild, HomeMacro_2_For_Lim) {
     char buffer[STRING_BUFFER_SIZE] = "MyBuffer";
     bool res = FlexDCAxis::buildHomeMacroCommand(buffer, 2, true, HOME_LS);
@@ -328,3 +451,133 @@ TEST(CommandBuild, MotorFault_1) {
     ASSERT_STREQ("YMF", buffer);
 }
 
+
+
+
+TEST(CommandBuild, Poll_0) {
+    char buffer[STRING_BUFFER_SIZE];
+    bool res = FlexDCAxis::buildPollCommand(buffer, 0);
+    ASSERT_EQ(true, res);
+    ASSERT_STREQ("XPS;XMO;XMS;XPA[11];XEM;XPE;XMF", buffer);
+}
+
+TEST(CommandBuild, Poll_1) {
+    char buffer[STRING_BUFFER_SIZE];
+    bool res = FlexDCAxis::buildPollCommand(buffer, 1);
+    ASSERT_EQ(true, res);
+    ASSERT_STREQ("YPS;YMO;YMS;YPA[11];YEM;YPE;YMF", buffer);
+}
+
+TEST(CommandBuild, Poll_2) {
+    char buffer[STRING_BUFFER_SIZE] = "MyBuffer";
+    bool res = FlexDCAxis::buildPollCommand(buffer, 2);
+    ASSERT_EQ(false, res);
+    ASSERT_STREQ("MyBuffer", buffer);
+}
+
+TEST(CommandBuild, ControllerPoll_2) {
+    char buffer[STRING_BUFFER_SIZE];
+    bool res = FlexDCAxis::buildControllerPollCommand(buffer, 2);
+    ASSERT_EQ(true, res);
+    ASSERT_STREQ("XPS;YPS;XMO;YMO;XMS;YMS;XPA[11];YPA[11];XEM;YEM;XPE;YPE;XMF;YMF", buffer);
+}
+
+TEST(CommandBuild, ControllerPoll_3) {
+    char buffer[STRING_BUFFER_SIZE] = "MyBuffer";
+    bool res = FlexDCAxis::buildControllerPollCommand(buffer, 3);
+    ASSERT_EQ(false, res);
+    ASSERT_STREQ("MyBuffer", buffer);
+}
+
+TEST(CommandBuild, PollParked_0) {
+    char buffer[STRING_BUFFER_SIZE];
+    bool res = FlexDCAxis::buildPollCommand(buffer, 0, POLL_PARKED_FIELDS);
+    ASSERT_EQ(true, res);
+    ASSERT_STREQ("XPS;XMF", buffer);
+}
+
+TEST(CommandBuild, PollNone_0) {
+    char buffer[STRING_BUFFER_SIZE] = "MyBuffer";
+    bool res = FlexDCAxis::buildPollCommand(buffer, 0, 0);
+    ASSERT_EQ(false, res);
+    ASSERT_STREQ("MyBuffer", buffer);
+}
+
+TEST(CommandBuild, ControllerPollParked_2) {
+    char buffer[STRING_BUFFER_SIZE];
+    unsigned int fields[] = { POLL_ALL_FIELDS, POLL_PARKED_FIELDS };
+    bool res = FlexDCAxis::buildControllerPollCommand(buffer, 2, fields);
+    ASSERT_EQ(true, res);
+    ASSERT_STREQ("XPS;YPS;XMO;XMS;XPA[11];XEM;XPE;XMF;YMF", buffer);
+}
+
+TEST(CommandBuild, ControllerPollSkipped_2) {
+    char buffer[STRING_BUFFER_SIZE];
+    unsigned int fields[] = { 0, POLL_PARKED_FIELDS };
+    bool res = FlexDCAxis::buildControllerPollCommand(buffer, 2, fields);
+    ASSERT_EQ(true, res);
+    ASSERT_STREQ("YPS;YMF", buffer);
+}
+
+TEST(CommandBuild, Capture_Both) {
+    char buffer[STRING_BUFFER_SIZE];
+    bool capture[] = { true, true };
+    bool res = FlexDCAxis::buildCaptureCommand(buffer, capture, 2);
+    ASSERT_EQ(true, res);
+    ASSERT_STREQ("XPS;XPE;YPS;YPE", buffer);
+}
+
+TEST(CommandBuild, Capture_Y) {
+    char buffer[STRING_BUFFER_SIZE];
+    bool capture[] = { false, true };
+    bool res = FlexDCAxis::buildCaptureCommand(buffer, capture, 2);
+    ASSERT_EQ(true, res);
+    ASSERT_STREQ("YPS;YPE", buffer);
+}
+
+TEST(CommandBuild, Capture_None) {
+    char buffer[STRING_BUFFER_SIZE];
+    bool capture[] = { false, false };
+    bool res = FlexDCAxis::buildCaptureCommand(buffer, capture, 2);
+    ASSERT_EQ(false, res);
+}
+
+TEST(UnitList, Single) {
+    ASSERT_EQ(1, FlexDCController::countUnits("NMCTRL"));
+    ASSERT_EQ(1, FlexDCController::countUnits(NULL));
+    ASSERT_EQ(NULL, FlexDCController::excessUnits("NMCTRL"));
+    ASSERT_EQ(NULL, FlexDCController::excessUnits(NULL));
+}
+
+TEST(UnitList, Several) {
+    ASSERT_EQ(3, FlexDCController::countUnits("NMCTRL1,NMCTRL2,NMCTRL3"));
+    ASSERT_EQ(NULL, FlexDCController::excessUnits("NMCTRL1,NMCTRL2,NMCTRL3"));
+}
+
+TEST(UnitList, TooMany) {
+    char names[4*FLEXDC_MAX_UNITS+8] = "A";
+    int unit;
+    for (unit=1; unit<FLEXDC_MAX_UNITS; unit++) strcat(names, ",A");
+    ASSERT_EQ(NULL, FlexDCController::excessUnits(names));
+    strcat(names, ",B,C");
+    ASSERT_EQ(FLEXDC_MAX_UNITS, FlexDCController::countUnits(names));
+    ASSERT_STREQ("B,C", FlexDCController::excessUnits(names));
+}
+
+TEST(CommandBuild, SettleWindow) {
+    char buffer[MAX_CONTROLLER_STRING_SIZE];
+    ASSERT_TRUE(FlexDCAxis::buildSettleWindowCommand(buffer, 1, 20, 10));
+    ASSERT_STREQ("YTR[1]=20;YTR[2]=10", buffer);
+    ASSERT_FALSE(FlexDCAxis::buildSettleWindowCommand(buffer, 2, 20, 10));
+    ASSERT_FALSE(FlexDCAxis::buildSettleWindowCommand(buffer, 0, -1, 10));
+    ASSERT_FALSE(FlexDCAxis::buildSettleWindowCommand(NULL, 0, 20, 10));
+}
+
+TEST(CommandBuild, SnapshotCheck) {
+    char buffer[MAX_CONTROLLER_STRING_SIZE];
+    ASSERT_TRUE(FlexDCAxis::buildSnapshotCheckCommand(buffer, 2));
+    ASSERT_STREQ("XPS;YPS;XPA[90]", buffer);
+    ASSERT_TRUE(FlexDCAxis::buildSnapshotTokenCommand(buffer, 4321));
+    ASSERT_STREQ("XPA[90]=4321", buffer);
+    ASSERT_FALSE(FlexDCAxis::buildSnapshotCheckCommand(buffer, 0));
+}
@@ -1,5 +1,7 @@
 #include <gtest/gtest.h>
 
+#include <stdio.h>
+
 #include "FlexDCMotorDriver.h"
 
 
@@ -147,3 +149,89 @@ TEST(ReplyParse, EmptyMotorFault) {
     ASSERT_EQ(asynError, asyn_error);
 }
 
+
+
+
+TEST(ReplySplit, PollReply) {
+    char reply[] = "-1500;1;0;1;1;-3;0";
+    char *fields[NUM_POLL_FIELDS];
+    int res = FlexDCAxis::splitReply(reply, fields, NUM_POLL_FIELDS);
+    ASSERT_EQ(NUM_POLL_FIELDS, res);
+    ASSERT_STREQ("-1500", fields[POLL_READBACK]);
+    ASSERT_STREQ("1", fields[POLL_POWER]);
+    ASSERT_STREQ("-3", fields[POLL_POSITION_ERROR]);
+    ASSERT_STREQ("0", fields[POLL_MOTOR_FAULT]);
+}
+
+TEST(ReplySplit, TrailingSeparatorAndSpaces) {
+    char reply[] = "10; 20 ;30;\r\n";
+    char *fields[4];
+    int res = FlexDCAxis::splitReply(reply, fields, 4);
+    ASSERT_EQ(3, res);
+    ASSERT_STREQ("10", fields[0]);
+    ASSERT_STREQ("20", fields[1]);
+    ASSERT_STREQ("30", fields[2]);
+}
+
+TEST(ReplySplit, EmptyField) {
+    char reply[] = "1;;3";
+    char *fields[3];
+    int res = FlexDCAxis::splitReply(reply, fields, 3);
+    ASSERT_EQ(3, res);
+    ASSERT_STREQ("", fields[1]);
+    ASSERT_STREQ("3", fields[2]);
+}
+
+TEST(ReplySplit, MissingFields) {
+    char reply[] = "1;2";
+    char *fields[NUM_POLL_FIELDS];
+    int res = FlexDCAxis::splitReply(reply, fields, NUM_POLL_FIELDS);
+    ASSERT_EQ(2, res);
+}
+
+TEST(ReplySplit, Empty) {
+    char reply[] = "";
+    char *fields[NUM_POLL_FIELDS];
+    int res = FlexDCAxis::splitReply(reply, fields, NUM_POLL_FIELDS);
+    ASSERT_EQ(0, res);
+}
+
+TEST(IntegerParse, Limits) {
+    char reply[32];
+    long value = 0;
+    sprintf(reply, "%ld", LONG_MAX);
+    ASSERT_EQ(true, FlexDCAxis::parseInteger(reply, value));
+    ASSERT_EQ(LONG_MAX, value);
+    sprintf(reply, "%ld", LONG_MIN);
+    ASSERT_EQ(true, FlexDCAxis::parseInteger(reply, value));
+    ASSERT_EQ(LONG_MIN, value);
+}
+
+TEST(IntegerParse, Overflow) {
+    char reply[32];
+    long value = 7;
+    sprintf(reply, "%ld0", LONG_MAX);
+    ASSERT_EQ(false, FlexDCAxis::parseInteger(reply, value));
+    sprintf(reply, "%ld", LONG_MIN);
+    reply[strlen(reply)-1]++;
+    ASSERT_EQ(false, FlexDCAxis::parseInteger(reply, value));
+    ASSERT_EQ(7, value);
+}
+
+TEST(IntegerParse, Range) {
+    long value;
+    ASSERT_EQ(true, FlexDCAxis::parseInteger("9", value, 0, 9));
+    ASSERT_EQ(false, FlexDCAxis::parseInteger("10", value, 0, 9));
+    ASSERT_EQ(false, FlexDCAxis::parseInteger("-1", value, 0, 9));
+    ASSERT_EQ(false, FlexDCAxis::parseInteger("-5", value, -3, 3));
+}
+
+TEST(IntegerParse, Malformed) {
+    long value;
+    ASSERT_EQ(false, FlexDCAxis::parseInteger("", value));
+    ASSERT_EQ(false, FlexDCAxis::parseInteger("-", value));
+    ASSERT_EQ(false, FlexDCAxis::parseInteger("12?", value));
+    ASSERT_EQ(false, FlexDCAxis::parseInteger(" 12", value));
+    ASSERT_EQ(true, FlexDCAxis::parseInteger("12\r\n", value));
+    ASSERT_EQ(12, value);
+}
@@ -20,6 +20,18 @@ public:
     asynStatus setMotionDone(int motion_status, flexdcMacroResult macro_result, bool power_on, long pos_error) {
         return FlexDCAxis::setMotionDone(motion_status, macro_result, power_on, pos_error);
     }
+
+    asynStatus updatePollFields(unsigned int mask, const asynStatus *status, char * const *fields, bool *moving) {
+        return FlexDCAxis::updatePollFields(mask, status, fields, moving);
+    }
+
+    void setHomeStage(flexdcHomeStage stage) {
+        FlexDCAxis::setHomeStage(stage);
+    }
+
+    void newMotionGeneration() {
+        FlexDCAxis::newMotionGeneration();
+    }
 };
 
 
@@ -61,3 +73,68 @@ TEST(setMotionDoneMock, MacroRunning) {
     dummy_axis.setMotionDone(0, EXECUTING, true, 10);
 }
 
+
+TEST(publishParamsMock, UnchangedSuppressed) {
+    MockFlexDCAxis dummy_axis(&dummy_ctrl);
+    asynStatus status[NUM_POLL_FIELDS] = { asynSuccess, asynSuccess };
+    char readback[] = "100", power[] = "0";
+    char *fields[NUM_POLL_FIELDS] = { readback, power };
+    bool moving;
+
+    EXPECT_CALL(dummy_axis, callParamCallbacks()).Times(1);
+    dummy_axis.updatePollFields(POLL_FIELD(POLL_READBACK) | POLL_FIELD(POLL_POWER), status, fields, &moving);
+    dummy_axis.updatePollFields(POLL_FIELD(POLL_READBACK) | POLL_FIELD(POLL_POWER), status, fields, &moving);
+}
+
+TEST(publishParamsMock, ChangedPublished) {
+    MockFlexDCAxis dummy_axis(&dummy_ctrl);
+    asynStatus status[NUM_POLL_FIELDS] = { asynSuccess };
+    char readback[] = "100";
+    char *fields[NUM_POLL_FIELDS] = { readback };
+    bool moving;
+
+    EXPECT_CALL(dummy_axis, callParamCallbacks()).Times(2);
+    dummy_axis.updatePollFields(POLL_FIELD(POLL_READBACK), status, fields, &moving);
+    readback[0] = '2';
+    dummy_axis.updatePollFields(POLL_FIELD(POLL_READBACK), status, fields, &moving);
+}
+
+TEST(homingMock, Stages) {
+    MockFlexDCAxis dummy_axis(&dummy_ctrl);
+    asynStatus status[NUM_POLL_FIELDS] = { asynSuccess, asynSuccess, asynSuccess, asynSuccess };
+    char motion_status[] = "2", macro_result[] = "0";
+    char *fields[NUM_POLL_FIELDS] = { NULL, NULL, motion_status, macro_result };
+    bool moving;
+    int home_stage;
+
+    ASSERT_EQ(asynSuccess, dummy_ctrl.findParam(AXIS_HOMSTG_PARAMNAME, &home_stage));
+    EXPECT_CALL(dummy_axis, setIntegerParam(testing::_, testing::_)).Times(testing::AnyNumber());
+    EXPECT_CALL(dummy_axis, setIntegerParam(home_stage, HOME_STARTED));
+    EXPECT_CALL(dummy_axis, setIntegerParam(home_stage, HOME_SEARCHING));
+    EXPECT_CALL(dummy_axis, setIntegerParam(home_stage, HOME_WAITING));
+    EXPECT_CALL(dummy_axis, setIntegerParam(home_stage, HOME_DONE));
+
+    dummy_axis.setHomeStage(HOME_STARTED);
+    dummy_axis.updatePollFields(POLL_HOME_FIELDS, status, fields, &moving);
+    motion_status[0] = '0';
+    dummy_axis.updatePollFields(POLL_HOME_FIELDS, status, fields, &moving);
+    macro_result[0] = '1';
+    dummy_axis.updatePollFields(POLL_HOME_FIELDS, status, fields, &moving);
+    dummy_axis.updatePollFields(POLL_HOME_FIELDS, status, fields, &moving);
+}
+
+TEST(updatePollFieldsMock, StaleMotionIgnored) {
+    MockFlexDCAxis dummy_axis(&dummy_ctrl);
+    asynStatus status[NUM_POLL_FIELDS] = { asynSuccess, asynSuccess, asynSuccess, asynSuccess, asynSuccess, asynSuccess };
+    char readback[] = "100", power[] = "1", motion_status[] = "0", macro_result[] = "1", pos_error[] = "0";
+    char *fields[NUM_POLL_FIELDS] = { readback, power, motion_status, macro_result, NULL, pos_error };
+    bool moving;
+
+    // A move was sent while this poll was in flight: its stopped, powered and settled status predates the move
+    EXPECT_CALL(dummy_axis, setIntegerParam(testing::_, testing::_)).Times(testing::AnyNumber());
+    EXPECT_CALL(dummy_axis, setIntegerParam(testing::_, 1)).Times(0);
+    EXPECT_CALL(dummy_axis, switchMotorPower(testing::_)).Times(0);
+
+    dummy_axis.newMotionGeneration();
+    dummy_axis.updatePollFields(POLL_FIELD(POLL_READBACK) | POLL_MOTION_FIELDS, status, fields, &moving);
+}
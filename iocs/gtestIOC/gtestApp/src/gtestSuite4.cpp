@@ -0,0 +1,86 @@
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <limits.h>
+
+#include "FlexDCMotorDriver.h"
+#include "FlexDCCommandEncoder.h"
+
+
+
+static const long ENCODER_VALUES[] = { 0, 1, -1, 9, -9, 10, -10, 123456, -654321, 2147483647L, -2147483647L-1, LONG_MAX, LONG_MIN };
+
+TEST(CommandEncoder, LongMatchesPrintf) {
+    char expected[MAX_CONTROLLER_STRING_SIZE];
+    char buffer[MAX_CONTROLLER_STRING_SIZE];
+    unsigned int v;
+
+    for (v=0; v<sizeof(ENCODER_VALUES)/sizeof(ENCODER_VALUES[0]); v++) {
+        FlexDCCommandBuffer out(buffer, sizeof(buffer));
+        out.put('X').put("AP=").put(ENCODER_VALUES[v]);
+        sprintf(expected, "XAP=%ld", ENCODER_VALUES[v]);
+        ASSERT_TRUE(out.ok());
+        ASSERT_STREQ(expected, buffer);
+    }
+}
+
+TEST(CommandEncoder, MoveMatchesPrintf) {
+    char expected[MAX_CONTROLLER_STRING_SIZE];
+    char buffer[MAX_CONTROLLER_STRING_SIZE];
+    long pos;
+
+    for (pos=-100000; pos<=100000; pos+=997) {
+        ASSERT_TRUE(FlexDCAxis::buildMoveCommand(buffer, 1, pos, false, 25000));
+        sprintf(expected, "YMO=1;YMM=0;YSM=0;YSP=%d;YAP=%ld;YBG", 25000, pos);
+        ASSERT_STREQ(expected, buffer);
+
+        ASSERT_TRUE(FlexDCAxis::buildMoveCommand(buffer, 0, pos, true, 1));
+        sprintf(expected, "XMO=1;XMM=0;XSM=0;XSP=%d;XRP=%ld;XBG", 1, pos);
+        ASSERT_STREQ(expected, buffer);
+    }
+}
+
+TEST(CommandEncoder, RecorderArmMatchesPrintf) {
+    char expected[MAX_CONTROLLER_STRING_SIZE];
+    char buffer[MAX_CONTROLLER_STRING_SIZE];
+
+    ASSERT_TRUE(FlexDCAxis::buildRecorderArmCommand(buffer, 0, 16, FLEXDC_MAX_RECORD_POINTS));
+    sprintf(expected, AXIS_REC_ARM_CMD, 'X', 'X', 'X', 16, 'X', FLEXDC_MAX_RECORD_POINTS, 'X');
+    ASSERT_STREQ(expected, buffer);
+}
+
+TEST(CommandEncoder, SettleWindowMatchesPrintf) {
+    char expected[MAX_CONTROLLER_STRING_SIZE];
+    char buffer[MAX_CONTROLLER_STRING_SIZE];
+
+    ASSERT_TRUE(FlexDCAxis::buildSettleWindowCommand(buffer, 0, 125, 0));
+    sprintf(expected, AXIS_SETTLE_WINDOW_CMD, 'X', 125, 'X', 0);
+    ASSERT_STREQ(expected, buffer);
+}
+
+TEST(CommandEncoder, SnapshotTokenMatchesPrintf) {
+    char expected[MAX_CONTROLLER_STRING_SIZE];
+    char buffer[MAX_CONTROLLER_STRING_SIZE];
+
+    ASSERT_TRUE(FlexDCAxis::buildSnapshotTokenCommand(buffer, 2147483647L));
+    sprintf(expected, AXIS_SETSNAPSHOT_TOKEN_CMD, 'X', 2147483647L);
+    ASSERT_STREQ(expected, buffer);
+}
+
+TEST(CommandEncoder, Overflow) {
+    char buffer[8];
+    FlexDCCommandBuffer out(buffer, sizeof(buffer));
+    out.put('X').put("SP=").put(LONG_MAX);
+    ASSERT_FALSE(out.ok());
+    ASSERT_STREQ("XSP=", buffer);
+}
+
+TEST(CommandEncoder, GenericGetFallback) {
+    char buffer[MAX_CONTROLLER_STRING_SIZE];
+    ASSERT_TRUE(FlexDCAxis::buildGenericGetCommand(buffer, "%cSP", 0));
+    ASSERT_STREQ("XSP", buffer);
+    ASSERT_TRUE(FlexDCAxis::buildGenericGetCommand(buffer, "VR", 1));
+    ASSERT_STREQ("VR", buffer);
+    ASSERT_TRUE(FlexDCAxis::buildGenericGetCommand(buffer, "%cTR[%%1]", 1));
+    ASSERT_STREQ("YTR[%1]", buffer);
+}
@@ -0,0 +1,376 @@
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+#include <epicsTime.h>
+
+#include "FlexDCCaptureRing.h"
+#include "FlexDCLatencyStats.h"
+#include "FlexDCCommandQueue.h"
+#include "FlexDCReplyCache.h"
+#include "FlexDCSnapshot.h"
+
+
+
+static FlexDCSample makeSample(long position) {
+    FlexDCSample sample;
+    sample.time.secPastEpoch = 0;
+    sample.time.nsec = 0;
+    sample.position = position;
+    sample.error = -position;
+    return sample;
+}
+
+TEST(CaptureRing, PushPop) {
+    static FlexDCCaptureRing ring;
+    FlexDCSample out[4];
+
+    ASSERT_EQ(true, ring.push(makeSample(1)));
+    ASSERT_EQ(true, ring.push(makeSample(2)));
+    ASSERT_EQ(2u, ring.pop(out, 4));
+    ASSERT_EQ(1, out[0].position);
+    ASSERT_EQ(-1, out[0].error);
+    ASSERT_EQ(2, out[1].position);
+    ASSERT_EQ(0u, ring.pop(out, 4));
+    ASSERT_EQ(0u, ring.getDropped());
+}
+
+TEST(CaptureRing, PartialPop) {
+    static FlexDCCaptureRing ring;
+    FlexDCSample out[2];
+    long position;
+
+    for (position=0; position<5; position++) {
+        ring.push(makeSample(position));
+    }
+    ASSERT_EQ(2u, ring.pop(out, 2));
+    ASSERT_EQ(0, out[0].position);
+    ASSERT_EQ(2u, ring.pop(out, 2));
+    ASSERT_EQ(2, out[0].position);
+    ASSERT_EQ(1u, ring.pop(out, 2));
+    ASSERT_EQ(4, out[0].position);
+}
+
+TEST(CaptureRing, OverflowDrops) {
+    static FlexDCCaptureRing ring;
+    static FlexDCSample out[FLEXDC_CAPTURE_RING_SIZE];
+    long position;
+
+    for (position=0; position<FLEXDC_CAPTURE_RING_SIZE; position++) {
+        ASSERT_EQ(true, ring.push(makeSample(position)));
+    }
+    ASSERT_EQ(false, ring.push(makeSample(-1)));
+    ASSERT_EQ(1u, ring.getDropped());
+
+    // Oldest samples are kept, the dropped one is the newest
+    ASSERT_EQ((size_t)FLEXDC_CAPTURE_RING_SIZE, ring.pop(out, FLEXDC_CAPTURE_RING_SIZE));
+    ASSERT_EQ(0, out[0].position);
+    ASSERT_EQ(FLEXDC_CAPTURE_RING_SIZE-1, out[FLEXDC_CAPTURE_RING_SIZE-1].position);
+}
+
+TEST(CaptureRing, Wraparound) {
+    static FlexDCCaptureRing ring;
+    FlexDCSample out[3];
+    long position;
+
+    for (position=0; position<3*FLEXDC_CAPTURE_RING_SIZE+1; position++) {
+        ASSERT_EQ(true, ring.push(makeSample(position)));
+        ASSERT_EQ(1u, ring.pop(out, 3));
+        ASSERT_EQ(position, out[0].position);
+    }
+    ASSERT_EQ(0u, ring.getDropped());
+}
+
+TEST(CaptureRing, Clear) {
+    static FlexDCCaptureRing ring;
+    FlexDCSample out[2];
+
+    ring.push(makeSample(1));
+    ring.push(makeSample(2));
+    ring.clear();
+    ASSERT_EQ(0u, ring.pop(out, 2));
+    ASSERT_EQ(true, ring.push(makeSample(3)));
+    ASSERT_EQ(1u, ring.pop(out, 2));
+    ASSERT_EQ(3, out[0].position);
+}
+
+TEST(LatencyHistogram, Buckets) {
+    ASSERT_EQ(0, FlexDCLatencyHistogram::bucket(0.0));
+    ASSERT_EQ(0, FlexDCLatencyHistogram::bucket(1.9e-6));
+    ASSERT_EQ(1, FlexDCLatencyHistogram::bucket(2e-6));
+    ASSERT_EQ(9, FlexDCLatencyHistogram::bucket(1e-3));
+    ASSERT_EQ(FLEXDC_LATENCY_BUCKETS-1, FlexDCLatencyHistogram::bucket(100.0));
+}
+
+TEST(LatencyHistogram, AddMerge) {
+    FlexDCLatencyHistogram first, second;
+
+    first.add(0.001);
+    first.add(0.003);
+    second.add(0.010);
+    first.merge(second);
+    ASSERT_EQ(3u, first.count);
+    ASSERT_DOUBLE_EQ(0.010, first.max);
+    ASSERT_NEAR(0.014/3, first.mean(), 1e-12);
+    ASSERT_EQ(1u, first.buckets[FlexDCLatencyHistogram::bucket(0.010)]);
+
+    first.clear();
+    ASSERT_EQ(0u, first.count);
+    ASSERT_DOUBLE_EQ(0.0, first.mean());
+}
+
+TEST(RollingStats, Percentiles) {
+    FlexDCRollingStats stats;
+    int sample;
+
+    ASSERT_DOUBLE_EQ(0.0, stats.percentile(0.99));
+    for (sample=100; sample>=1; sample--) {
+        stats.add(sample*0.001);
+    }
+    ASSERT_EQ(100, stats.count);
+    ASSERT_DOUBLE_EQ(0.001, stats.min());
+    ASSERT_NEAR(0.0505, stats.mean(), 1e-12);
+    ASSERT_DOUBLE_EQ(0.099, stats.percentile(0.99));
+    ASSERT_DOUBLE_EQ(0.050, stats.percentile(0.5));
+    ASSERT_DOUBLE_EQ(0.100, stats.percentile(1.0));
+}
+
+TEST(RollingStats, Window) {
+    FlexDCRollingStats stats;
+    int sample;
+
+    for (sample=0; sample<FLEXDC_ROLLING_SAMPLES; sample++) {
+        stats.add(1.0);
+    }
+    stats.add(0.5);
+    ASSERT_EQ(FLEXDC_ROLLING_SAMPLES, stats.count);
+    ASSERT_DOUBLE_EQ(0.5, stats.min());
+    ASSERT_DOUBLE_EQ(1.0, stats.percentile(0.99));
+
+    stats.clear();
+    ASSERT_EQ(0, stats.count);
+    ASSERT_DOUBLE_EQ(0.0, stats.mean());
+}
+
+TEST(ExchangeKind, Classify) {
+    ASSERT_EQ(EXCH_PS, FlexDCCommandQueue::classify("XPS"));
+    ASSERT_EQ(EXCH_PA, FlexDCCommandQueue::classify("YPA[11]"));
+    ASSERT_EQ(EXCH_MF, FlexDCCommandQueue::classify("YMF"));
+    ASSERT_EQ(EXCH_MOVE, FlexDCCommandQueue::classify("XMO=1;XMM=0;XSM=0;XSP=100;XAP=5;XBG"));
+    ASSERT_EQ(EXCH_MOVE, FlexDCCommandQueue::classify("XMO=1;XAP=5;YMO=1;YAP=5;ABG"));
+    ASSERT_EQ(EXCH_STOP, FlexDCCommandQueue::classify("YST"));
+    ASSERT_EQ(EXCH_BATCH, FlexDCCommandQueue::classify("XPS;YPS;XMO;YMO"));
+    ASSERT_EQ(EXCH_OTHER, FlexDCCommandQueue::classify("XPS=100"));
+    ASSERT_EQ(EXCH_OTHER, FlexDCCommandQueue::classify("XVR"));
+}
+
+TEST(CommandQueue, ClassifyBatch) {
+    ASSERT_EQ((1u << EXCH_PS) | (1u << EXCH_MO), FlexDCCommandQueue::classifyBatch("XPS;YPS;XMO;YMO"));
+    ASSERT_EQ((1u << EXCH_PS) | (1u << EXCH_PA) | (1u << EXCH_MF), FlexDCCommandQueue::classifyBatch("XPS;YPS;XPA[11];XMF;YMF"));
+    ASSERT_EQ(1u << EXCH_PE, FlexDCCommandQueue::classifyBatch("XPE;XRR"));
+    ASSERT_EQ(0u, FlexDCCommandQueue::classifyBatch("XTS;XRR"));
+}
+
+
+
+/** Replies to everything, or fails everything, on demand.
+  * Can also hold back requests from the I/O thread, to transfer them together, and time out one of them.
+  *
+  */
+class ScriptedQueue: public FlexDCCommandQueue {
+
+public:
+    ScriptedQueue(): FlexDCCommandQueue("GTEST_SCRIPTED", NULL), failing(false), holding(false), timeoutRequest(-1) {}
+
+    asynStatus exchange() {
+        char reply[MAX_CONTROLLER_STRING_SIZE];
+        FlexDCRequest *request = post("XPS", true, 0.1);
+
+        wait(request);
+        return release(request, reply, sizeof(reply));
+    }
+
+    int processHeld() {
+        FlexDCRequest *requests[FLEXDC_PIPELINE_DEPTH];
+        int num_requests = FlexDCCommandQueue::takePending(requests, FLEXDC_PIPELINE_DEPTH);
+
+        process(requests, num_requests);
+        return num_requests;
+    }
+
+    bool failing;
+    bool holding;
+    int timeoutRequest;
+
+protected:
+    int takePending(FlexDCRequest **requests, int max_requests) {
+        return this->holding ? 0 : FlexDCCommandQueue::takePending(requests, max_requests);
+    }
+
+    void transfer(FlexDCRequest **requests, int num_requests) {
+        int req;
+
+        for (req=0; req<num_requests; req++) {
+            strcpy(requests[req]->reply, "1");
+            // Like a real transfer, no reply is read after the one that timed out
+            requests[req]->status = (this->failing) || ((this->timeoutRequest >= 0) && (req >= this->timeoutRequest)) ? asynTimeout : asynSuccess;
+        }
+    }
+};
+
+TEST(CommandQueue, ConsecutiveFailures) {
+    static ScriptedQueue queue;
+
+    ASSERT_EQ(asynSuccess, queue.exchange());
+    ASSERT_EQ(0, queue.getConsecutiveFailures());
+
+    queue.failing = true;
+    ASSERT_EQ(asynTimeout, queue.exchange());
+    ASSERT_EQ(asynTimeout, queue.exchange());
+    ASSERT_EQ(2, queue.getConsecutiveFailures());
+
+    queue.failing = false;
+    ASSERT_EQ(asynSuccess, queue.exchange());
+    ASSERT_EQ(0, queue.getConsecutiveFailures());
+}
+
+TEST(CommandQueue, FailedBatchCountsOnce) {
+    static ScriptedQueue queue;
+    FlexDCRequest *requests[4];
+    asynStatus status[4];
+    int req;
+
+    // The second reply times out, so the last two are never read
+    queue.holding = true;
+    for (req=0; req<4; req++) {
+        requests[req] = queue.post("XPS", true, 0.1);
+    }
+    queue.timeoutRequest = 1;
+    ASSERT_EQ(4, queue.processHeld());
+    queue.holding = false;
+
+    for (req=0; req<4; req++) {
+        queue.wait(requests[req]);
+        status[req] = queue.release(requests[req], NULL, 0);
+    }
+    ASSERT_EQ(asynSuccess, status[0]);
+    ASSERT_EQ(asynTimeout, status[1]);
+    ASSERT_EQ(asynTimeout, status[3]);
+    ASSERT_EQ(1, queue.getConsecutiveFailures());
+
+    queue.timeoutRequest = -1;
+    ASSERT_EQ(asynSuccess, queue.exchange());
+    ASSERT_EQ(0, queue.getConsecutiveFailures());
+}
+
+TEST(ReplyCache, StoreLookup) {
+    static FlexDCReplyCache cache;
+    char reply[MAX_CONTROLLER_STRING_SIZE];
+
+    ASSERT_EQ(false, cache.lookup("XVR", reply, sizeof(reply), 60.0));
+    cache.store("XVR", "FlexDC 1.2");
+    cache.store("YSP", "2500");
+    ASSERT_EQ(true, cache.lookup("XVR", reply, sizeof(reply), 60.0));
+    ASSERT_STREQ("FlexDC 1.2", reply);
+    ASSERT_EQ(true, cache.lookup("YSP", reply, sizeof(reply), 60.0));
+    ASSERT_STREQ("2500", reply);
+    ASSERT_EQ(false, cache.lookup("XSP", reply, sizeof(reply), 60.0));
+    ASSERT_EQ(false, cache.lookup("YSP", reply, sizeof(reply), -1.0));
+    ASSERT_EQ(2u, cache.hits);
+    ASSERT_EQ(3u, cache.misses);
+}
+
+TEST(ReplyCache, Invalidate) {
+    static FlexDCReplyCache cache;
+    char reply[MAX_CONTROLLER_STRING_SIZE];
+
+    cache.store("XVR", "FlexDC 1.2");
+    cache.store("XSP", "1000");
+    cache.store("YSP", "2000");
+    cache.invalidate("XMO=1;XMM=0;XSM=0;XSP=1500;XAP=100;XBG");
+    ASSERT_EQ(false, cache.lookup("XSP", reply, sizeof(reply), 60.0));
+    ASSERT_EQ(true, cache.lookup("YSP", reply, sizeof(reply), 60.0));
+
+    cache.store("XSP", "1500");
+    cache.invalidate("ASP=10");
+    ASSERT_EQ(false, cache.lookup("XSP", reply, sizeof(reply), 60.0));
+    ASSERT_EQ(false, cache.lookup("YSP", reply, sizeof(reply), 60.0));
+    ASSERT_EQ(true, cache.lookup("XVR", reply, sizeof(reply), 60.0));
+
+    cache.invalidate("XPS;YPS");
+    ASSERT_EQ(true, cache.lookup("XVR", reply, sizeof(reply), 60.0));
+    cache.invalidate("XQK;YQK;AMO=0;XRS");
+    ASSERT_EQ(false, cache.lookup("XVR", reply, sizeof(reply), 60.0));
+}
+
+TEST(ReplyCache, Eviction) {
+    static FlexDCReplyCache cache;
+    char reply[MAX_CONTROLLER_STRING_SIZE], command[16];
+    int entry;
+
+    for (entry=0; entry<=FLEXDC_REPLY_CACHE_SIZE; entry++) {
+        snprintf(command, sizeof(command), "XV[%d]", entry);
+        cache.store(command, "1");
+    }
+    ASSERT_EQ(false, cache.lookup("XV[0]", reply, sizeof(reply), 60.0));
+    ASSERT_EQ(true, cache.lookup("XV[1]", reply, sizeof(reply), 60.0));
+    snprintf(command, sizeof(command), "XV[%d]", FLEXDC_REPLY_CACHE_SIZE);
+    ASSERT_EQ(true, cache.lookup(command, reply, sizeof(reply), 60.0));
+
+    cache.store("XPS;YPS;XMO;YMO;XMS;YMS", "1;2;1;1;0;0");
+    ASSERT_EQ(false, cache.lookup("XPS;YPS;XMO;YMO;XMS;YMS", reply, sizeof(reply), 60.0));
+}
+
+TEST(Snapshot, WriteRead) {
+    const char *path = "gtest_flexdc_snapshot.dat";
+    FlexDCAxisSnapshot saved[3] = { { 1000, 1, 1 }, { -25, 0, 8 }, { 0, 1, 7 } };
+    FlexDCAxisSnapshot restored[4];
+    epicsInt32 token = 0;
+
+    remove(path);
+    ASSERT_EQ(-1, FlexDCSnapshot::read(path, restored, 4, &token));
+
+    ASSERT_EQ(true, FlexDCSnapshot::write(path, saved, 3, 1234));
+    ASSERT_EQ(3, FlexDCSnapshot::read(path, restored, 4, &token));
+    ASSERT_EQ(1234, token);
+    ASSERT_EQ(1000, restored[0].position);
+    ASSERT_EQ(1, restored[0].homed);
+    ASSERT_EQ(-25, restored[1].position);
+    ASSERT_EQ(8, restored[1].motionEnd);
+    ASSERT_EQ(2, FlexDCSnapshot::read(path, restored, 2, &token));
+
+    saved[0].position = 2000;
+    ASSERT_EQ(true, FlexDCSnapshot::write(path, saved, 1, 1234));
+    ASSERT_EQ(1, FlexDCSnapshot::read(path, restored, 4, &token));
+    ASSERT_EQ(2000, restored[0].position);
+
+    remove(path);
+}
+
+TEST(Snapshot, Rejected) {
+    const char *path = "gtest_flexdc_snapshot_bad.dat";
+    FlexDCSnapshotHeader header;
+    FlexDCAxisSnapshot restored[2];
+    epicsInt32 token;
+    FILE *fp;
+
+    memcpy(header.magic, FLEXDC_SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = FLEXDC_SNAPSHOT_VERSION+1;
+    header.numAxes = 0;
+    header.token = 1234;
+    fp = fopen(path, "wb");
+    fwrite(&header, sizeof(header), 1, fp);
+    fclose(fp);
+    ASSERT_EQ(-1, FlexDCSnapshot::read(path, restored, 2, &token));
+
+    // Truncated
+    header.version = FLEXDC_SNAPSHOT_VERSION;
+    header.numAxes = 2;
+    fp = fopen(path, "wb");
+    fwrite(&header, sizeof(header), 1, fp);
+    fwrite(restored, sizeof(*restored), 1, fp);
+    fclose(fp);
+    ASSERT_EQ(-1, FlexDCSnapshot::read(path, restored, 2, &token));
+
+    remove(path);
+}
@@ -0,0 +1,154 @@
+#include <string.h>
+
+#include <gtest/gtest.h>
+
+#include <epicsThread.h>
+
+#include "FlexDCSimulator.h"
+
+
+
+// Sends a line and strips the '>' acknowledgement from its reply, as the input EOS of the driver does
+static bool query(FlexDCSimulator &simulator, const char *line, char *reply, size_t max_length) {
+    double latency;
+    size_t len;
+
+    if (!simulator.processLine(line, reply, max_length, &latency)) {
+        return false;
+    }
+    len = strlen(reply);
+    if ((len > 0) && (reply[len-1] == '>')) reply[len-1] = '\0';
+    return true;
+}
+
+static std::string exchange(FlexDCSimulator &simulator, const char *line) {
+    char reply[MAX_CONTROLLER_STRING_SIZE+2];
+    double latency;
+
+    if (!simulator.processLine(line, reply, sizeof(reply), &latency)) {
+        return "<dropped>";
+    }
+    return reply;
+}
+
+TEST(Simulator, Version) {
+    FlexDCSimulator simulator(0, 0.0);
+
+    ASSERT_EQ(std::string(SIM_VERSION) + ">", exchange(simulator, "XVR"));
+}
+
+TEST(Simulator, SetGet) {
+    FlexDCSimulator simulator(0, 0.0);
+
+    ASSERT_EQ(">", exchange(simulator, "XPS=1234"));
+    ASSERT_EQ("1234>", exchange(simulator, "XPS"));
+    ASSERT_EQ("0>", exchange(simulator, "YPS"));
+    ASSERT_EQ(">", exchange(simulator, "YKP=42"));
+    ASSERT_EQ("42>", exchange(simulator, "YKP"));
+    ASSERT_EQ("0>", exchange(simulator, "XKP"));
+}
+
+TEST(Simulator, ChainedQueries) {
+    FlexDCSimulator simulator(0, 0.0);
+
+    ASSERT_EQ(">", exchange(simulator, "XPS=10;YPS=20;AMO=1"));
+    ASSERT_EQ("10;1;0;20;1;0>", exchange(simulator, "XPS;XMO;XMS;YPS;YMO;YMS"));
+}
+
+TEST(Simulator, Malformed) {
+    FlexDCSimulator simulator(0, 0.0);
+
+    ASSERT_EQ("?>", exchange(simulator, "ZPS"));
+    ASSERT_EQ("?>", exchange(simulator, "XPS=abc"));
+}
+
+TEST(Simulator, Latency) {
+    FlexDCSimulator simulator(0, 0.001);
+    char reply[MAX_CONTROLLER_STRING_SIZE+2];
+    double latency;
+
+    simulator.setLatency("PS", 0.01);
+    simulator.processLine("XPS;XMO", reply, sizeof(reply), &latency);
+    ASSERT_DOUBLE_EQ(0.011, latency);
+}
+
+TEST(Simulator, Move) {
+    FlexDCSimulator simulator(0, 0.0);
+
+    ASSERT_EQ(">", exchange(simulator, "XAP=1000;XBG"));
+    ASSERT_EQ(std::to_string(MOTOR_OFF) + ">", exchange(simulator, "XEM"));
+
+    ASSERT_EQ(">", exchange(simulator, "XSP=100000000;XMO=1;XAP=1000;XBG"));
+    ASSERT_EQ(std::to_string(IN_MOTION) + ";" + std::to_string(SIM_MOVING_STATUS) + ">", exchange(simulator, "XEM;XMS"));
+    epicsThreadSleep(0.01);
+    ASSERT_EQ("1000;0;" + std::to_string(NORMAL) + ">", exchange(simulator, "XPS;XMS;XEM"));
+
+    ASSERT_EQ(">", exchange(simulator, "XRP=-500;XBG"));
+    epicsThreadSleep(0.01);
+    ASSERT_EQ("500>", exchange(simulator, "XPS"));
+}
+
+TEST(Simulator, MotorOffStops) {
+    FlexDCSimulator simulator(0, 0.0);
+
+    ASSERT_EQ(">", exchange(simulator, "XSP=1;XMO=1;XAP=1000000;XBG;XMO=0"));
+    ASSERT_EQ("0;0;" + std::to_string(MOTOR_OFF) + ">", exchange(simulator, "XMO;XMS;XEM"));
+}
+
+TEST(Simulator, Homing) {
+    FlexDCSimulator simulator(0, 0.0);
+
+    ASSERT_EQ(">", exchange(simulator, "XPS=5000;XSP=100000000;XQE,#HINRI"));
+    epicsThreadSleep(0.01);
+    ASSERT_EQ("0;1;" + std::to_string(OK) + ">", exchange(simulator, "XPS;XMO;XPA[11]"));
+}
+
+TEST(Simulator, Faults) {
+    FlexDCSimulator simulator(0, 0.0);
+
+    ASSERT_EQ(asynSuccess, simulator.setFault("YMF", 4));
+    ASSERT_EQ("0;4>", exchange(simulator, "XMF;YMF"));
+    ASSERT_EQ(">", exchange(simulator, "YMO=1;YAP=10;YBG"));
+    ASSERT_EQ(std::to_string(MOTOR_FAULT) + ">", exchange(simulator, "YEM"));
+
+    ASSERT_EQ(asynSuccess, simulator.setFault("error", 100));
+    ASSERT_EQ("?>", exchange(simulator, "XPS"));
+    ASSERT_EQ(asynSuccess, simulator.setFault("drop", 100));
+    ASSERT_EQ("<dropped>", exchange(simulator, "XPS"));
+    ASSERT_EQ(asynError, simulator.setFault("unknown", 1));
+
+    ASSERT_EQ(asynSuccess, simulator.setFault("drop", 0));
+    ASSERT_EQ(asynSuccess, simulator.setFault("error", 0));
+    ASSERT_EQ(">", exchange(simulator, "ARS"));
+    ASSERT_EQ("0>", exchange(simulator, "YMF"));
+}
+
+TEST(Simulator, SnapshotAfterReset) {
+    FlexDCSimulator simulator(0, 0.0);
+    FlexDCAxisSnapshot saved[CTRL_NUM_AXES] = {{0, 1, 0}, {300, 0, 0}};
+    char command[MAX_CONTROLLER_STRING_SIZE];
+    char reply[MAX_CONTROLLER_STRING_SIZE+2];
+    long positions[CTRL_NUM_AXES];
+    bool restore[CTRL_NUM_AXES];
+
+    ASSERT_TRUE(FlexDCAxis::buildSnapshotTokenCommand(command, 4321));
+    ASSERT_EQ(">", exchange(simulator, command));
+    ASSERT_EQ(">", exchange(simulator, "YPS=305"));
+
+    ASSERT_TRUE(FlexDCAxis::buildSnapshotCheckCommand(command, CTRL_NUM_AXES));
+    ASSERT_TRUE(query(simulator, command, reply, sizeof(reply)));
+    ASSERT_EQ(2, FlexDCController::checkSnapshot(reply, saved, CTRL_NUM_AXES, 4321, positions, restore));
+    ASSERT_EQ(305, positions[1]);
+
+    // Saved at 0 and still reading 0 after the reset, yet not restored
+    ASSERT_EQ(">", exchange(simulator, "XRS"));
+    ASSERT_TRUE(query(simulator, command, reply, sizeof(reply)));
+    ASSERT_EQ(0, FlexDCController::checkSnapshot(reply, saved, CTRL_NUM_AXES, 4321, positions, restore));
+    ASSERT_EQ(0, positions[0]);
+    ASSERT_FALSE(restore[0]);
+
+    // Nor without a token, or when the query failed
+    ASSERT_EQ(0, FlexDCController::checkSnapshot(reply, saved, CTRL_NUM_AXES, 0, positions, restore));
+    reply[0] = '\0';
+    ASSERT_EQ(0, FlexDCController::checkSnapshot(reply, saved, CTRL_NUM_AXES, 4321, positions, restore));
+}